@@ -49,7 +49,8 @@ LISP load path (except the current directory)."
 	    ((full-name (expand-file-name file (car dirs))))
 	  (when (or (file-exists-p full-name)
 		    (file-exists-p (concat full-name ".jl"))
-		    (file-exists-p (concat full-name ".jlc")))
+		    (file-exists-p (concat full-name ".jlc"))
+		    (file-exists-p (concat full-name ".jlb")))
 	    (if callback
 		(callback full-name)
 	      (load full-name nil t)))))
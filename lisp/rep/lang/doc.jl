@@ -31,6 +31,7 @@
 	    doc-file-param-key
 	    doc-file-ref
 	    doc-file-set
+	    doc-file-merge
 	    documentation
 	    document-variable
 	    add-documentation
@@ -133,6 +134,20 @@ NAME is true, then it should be the symbol that is associated with VALUE."
 	    (gdbm-store db key value 'replace)
 	  (gdbm-close db)))))
 
+  (defun doc-file-merge (file)
+    "Copy all doc strings stored in the database FILE into the current
+documentation file."
+    (require 'rep.io.db.gdbm)
+    (let ((from (gdbm-open file 'read nil '(no-lock))))
+      (unwind-protect
+	  (let ((db (gdbm-open documentation-file 'append nil '(no-lock))))
+	    (unwind-protect
+		(gdbm-walk (lambda (key)
+			     (gdbm-store db key (gdbm-fetch from key) 'replace))
+			   from)
+	      (gdbm-close db)))
+	(gdbm-close from))))
+
 
 ;;; Accessing doc strings
 
@@ -34,6 +34,10 @@ Jade, select this file, then evaluate:
 ;;; ::autoload-start::
 (autoload-self-test 'rep.data.queues 'rep.data.queues)
 (autoload-self-test 'rep.data 'rep.test.data)
+(autoload-self-test 'rep.data.tables 'rep.test.tables)
+(autoload-self-test 'rep.lang.interpreter 'rep.test.interpreter)
+(autoload-self-test 'rep.lang.symbols 'rep.test.symbols)
+(autoload-self-test 'rep.structures 'rep.test.structures)
 (autoload-self-test 'rep.www.quote-url 'rep.www.quote-url)
 (autoload-self-test 'rep.www.cgi-get 'rep.www.cgi-get)
 ;;; ::autoload-end::
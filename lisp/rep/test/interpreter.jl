@@ -0,0 +1,167 @@
+#| rep.test.interpreter -- checks for rep.lang.interpreter module
+
+   $Id$
+
+   This file is part of librep.
+
+   librep is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   librep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with librep; see the file COPYING.  If not, write to
+   the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+|#
+
+
+(define-structure rep.lang.interpreter.self-tests ()
+
+    (open rep
+	  rep.regexp
+	  rep.structures
+	  rep.test.framework)
+
+  ;; this module is compiled, so the code being tested is evaluated
+  ;; in fresh structures to make sure it's interpreted
+
+  (define (fresh-structure #!rest modules)
+    (eval `(structure () (open rep ,@modules))))
+
+  ;; the pre-expanded bodies of interpreted functions follow changes
+  ;; to the macros they use
+  (define (expansion-self-test)
+    (let ((s (fresh-structure)))
+
+      ;; redefined part way through the body that uses it
+      (eval '(defmacro test-macro () ''old) s)
+      (eval '(defun test-fun ()
+	       (defmacro test-macro () ''new)
+	       (test-macro)) s)
+      (test (eq (eval '(test-fun) s) 'new))
+
+      ;; redefined after a closure using it was made
+      (eval '(defmacro test-macro () ''old) s)
+      (eval '(defun test-maker () (lambda () (test-macro))) s)
+      (eval '(define test-closure (test-maker)) s)
+      (test (eq (eval '(test-closure) s) 'old))
+      (eval '(defmacro test-macro () ''new) s)
+      (test (eq (eval '(test-closure) s) 'new))))
+
+  ;; and changes to what the names of macros refer to
+  (define (import-self-test)
+    (name-structure (eval '(structure (export test-name)
+			     (open rep)
+			     (defmacro test-name () ''macro)))
+		    'rep.test.interpreter.macro)
+    (name-structure (eval '(structure (export test-name)
+			     (open rep)
+			     (defun test-name () 'function)))
+		    'rep.test.interpreter.function)
+
+    ;; opening a module that shadows the macro
+    (let ((s (fresh-structure 'rep.test.interpreter.macro)))
+      (eval '(defun test-fun () (test-name)) s)
+      (test (eq (eval '(test-fun) s) 'macro))
+      (eval `(,open-structures '(rep.test.interpreter.function)) s)
+      (test (eq (eval '(test-fun) s) 'function)))
+
+    ;; a local definition that shadows the macro
+    (let ((s (fresh-structure 'rep.test.interpreter.macro)))
+      (eval '(defun test-fun () (test-name)) s)
+      (test (eq (eval '(test-fun) s) 'macro))
+      (eval '(defun test-name () 'local) s)
+      (test (eq (eval '(test-fun) s) 'local))))
+
+  ;; arguments are bound through the parsed lambda list the same way
+  ;; on the first call and on later ones
+  (define (lambda-list-self-test)
+    (let ((s (fresh-structure)))
+      (eval '(defun test-optional (a #!optional b (c (+ 1 2)) #!rest r)
+	       (list a b c r)) s)
+      (eval '(defun test-key (a #!key b (c 3) d)
+	       (list a b c d)) s)
+      (do ((i 0 (1+ i)))
+	  ((= i 2))
+	(test (equal (eval '(test-optional 1) s) '(1 () 3 ())))
+	(test (equal (eval '(test-optional 1 2) s) '(1 2 3 ())))
+	(test (equal (eval '(test-optional 1 2 4 5 6) s) '(1 2 4 (5 6))))
+	(test (equal (eval '(apply test-optional '(1 2 4 5)) s)
+		     '(1 2 4 (5))))
+	(test (equal (eval '(test-key 1) s) '(1 () 3 ())))
+	(test (equal (eval '(test-key 1 #:c 5) s) '(1 () 5 ())))
+	(test (equal (eval '(test-key 1 #:d 7 #:b 2) s) '(1 2 3 7)))
+	(test (equal (eval '(funcall (lambda (#!rest x) x) 1 2) s) '(1 2)))
+	(test (eq (car (condition-case data
+			   (eval '(test-optional) s)
+			 (missing-arg data)))
+		  'missing-arg)))
+
+      ;; redefining the function replaces its lambda list
+      (eval '(defun test-optional (#!key a) a) s)
+      (test (eql (eval '(test-optional #:a 1) s) 1))))
+
+  ;; macroexpand remembers expansions across garbage collections, for
+  ;; each structure separately, until the macro is redefined
+  (define (macroexpand-self-test)
+    (let ((s (fresh-structure))
+	  (other (fresh-structure))
+	  (form (list 'test-macro 1)))
+      (define (expand-in structure)
+	(eval `(macroexpand ',form) structure))
+      (eval '(defmacro test-macro (x) (list 'quote (list 'old x))) s)
+      (eval '(defmacro test-macro (x) (list 'quote (list 'other x))) other)
+
+      (let ((first (expand-in s))
+	    (hits (car (macroexpand-statistics))))
+	(garbage-collect)
+	(test (eq (expand-in s) first))
+	(test (= (car (macroexpand-statistics)) (1+ hits))))
+      (test (equal (expand-in other) ''(other 1)))
+
+      (eval '(defmacro test-macro (x) (list 'quote (list 'new x))) s)
+      (test (equal (expand-in s) ''(new 1)))))
+
+  ;; interpreted calls of primitives treat their arguments as apply does
+  (define (subr-call-self-test)
+    (let ((s (fresh-structure)))
+      ;; missing arguments are nil, surplus ones are evaluated and ignored
+      (test (equal (eval '(cons 1) s) '(1)))
+      (test (equal (eval '(substring "abcdef" 2) s) "cdef"))
+      (test (equal (eval '(let ((n 0))
+			    (list (car '(1 2) (setq n (1+ n)) (setq n (1+ n)))
+				  n)) s)
+		   '(1 2)))
+      (test (eq (car (condition-case data
+			 (eval '(aref [1 2]) s)
+		       (bad-arg data)))
+		'bad-arg))
+
+      ;; arguments are evaluated from left to right
+      (test (equal (eval '(let ((l '()))
+			    (cons (setq l (cons 1 l)) (setq l (cons 2 l)))) s)
+		   '((1) 2 1)))
+
+      ;; backtraces show the argument lists of primitives
+      (test (string-match "mapcar \\(#<closure [^>]*> \\(test-argument\\)\\)"
+			  (car (eval '(mapcar
+				       (lambda (x)
+					 (let ((stream (make-string-output-stream)))
+					   (backtrace stream)
+					   (get-output-stream-string stream)))
+				       (list 'test-argument)) s))))))
+
+  (define (self-test)
+    (expansion-self-test)
+    (import-self-test)
+    (lambda-list-self-test)
+    (macroexpand-self-test)
+    (subr-call-self-test))
+
+  ;;###autoload
+  (define-self-test 'rep.lang.interpreter self-test))
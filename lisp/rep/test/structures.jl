@@ -0,0 +1,109 @@
+#| rep.test.structures -- checks for rep.structures module
+
+   $Id$
+
+   This file is part of librep.
+
+   librep is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   librep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with librep; see the file COPYING.  If not, write to
+   the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+|#
+
+
+(define-structure rep.structures.self-tests ()
+
+    (open rep
+	  rep.structures
+	  rep.test.framework)
+
+  (define (make-test-structures)
+    (name-structure (eval '(structure (export test-var)
+			     (open rep)
+			     (define test-var 'first)))
+		    'rep.test.structures.first)
+    (name-structure (eval '(structure (export test-var)
+			     (open rep)))
+		    'rep.test.structures.second)
+    ;; the structure opened last is searched first
+    (eval '(structure ()
+	     (open rep
+		   rep.test.structures.first
+		   rep.test.structures.second))))
+
+  ;; imported bindings are cached, and the cache notices bindings
+  ;; that would now be found instead
+  (define (cache-self-test)
+    (let ((s (make-test-structures)))
+      (test (eq (eval 'test-var s) 'first))
+      (let ((hits (car (structure-cache-statistics))))
+	(test (eq (eval 'test-var s) 'first))
+	(test (> (car (structure-cache-statistics)) hits)))
+      (test (= (length (structure-cache-statistics)) 5))
+
+      ;; a new binding in a structure searched earlier
+      (structure-define (get-structure 'rep.test.structures.second)
+			'test-var 'second)
+      (test (eq (eval 'test-var s) 'second))
+
+      ;; a local binding, then its removal
+      (structure-define s 'test-var 'local)
+      (test (eq (eval 'test-var s) 'local))
+      (eval '(makunbound 'test-var) s)
+      (test (eq (eval 'test-var s) 'second))))
+
+  ;; references from compiled code to bindings that are immutable by
+  ;; the time the module has been loaded become constants
+  (define (folding-self-test)
+    (let* ((c (eval '(structure (export test-const)
+		       (open rep rep.structures)
+		       (define test-const 'constant))))
+	   (s (progn
+		(name-structure c 'rep.test.structures.constant)
+		;; compiled before the binding is made immutable, so
+		;; only the linker can fold the reference
+		(eval `(structure ()
+			 (open rep
+			       rep.vm.compiler
+			       rep.test.structures.constant)
+			 (define test-fun
+			   (compile-function (lambda () test-const)))
+			 (define test-constants
+			   (copy-sequence (aref (closure-function test-fun) 1)))
+			 (,eval '(make-binding-immutable 'test-const) ,c))))))
+      (test (equal (eval 'test-constants s) [test-const]))
+      (test (equal (aref (closure-function (eval 'test-fun s)) 1)
+		   [constant]))
+      (test (eq (eval '(test-fun) s) 'constant))
+
+      ;; the folded value isn't shadowed by a later local binding
+      (structure-define s 'test-const 'local)
+      (test (eq (eval '(test-fun) s) 'constant))
+
+      ;; the constant can't be changed or removed
+      (test (condition-case nil
+		(progn (structure-set c 'test-const 'changed) nil)
+	      (setting-constant t)))
+      (test (condition-case nil
+		(progn (structure-define c 'test-const 'changed) nil)
+	      (setting-constant t)))
+      (test (condition-case nil
+		(progn (eval '(makunbound 'test-const) c) nil)
+	      (setting-constant t)))
+      (test (eq (eval 'test-const c) 'constant))))
+
+  (define (self-test)
+    (cache-self-test)
+    (folding-self-test))
+
+  ;;###autoload
+  (define-self-test 'rep.structures self-test))
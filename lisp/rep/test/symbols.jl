@@ -0,0 +1,131 @@
+#| rep.test.symbols -- checks for rep.lang.symbols module
+
+   $Id$
+
+   This file is part of librep.
+
+   librep is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   librep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with librep; see the file COPYING.  If not, write to
+   the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+|#
+
+
+(define-structure rep.lang.symbols.self-tests ()
+
+    (open rep
+	  rep.test.framework)
+
+  (define symbol-count 20000)
+
+  (define (symbol-name-for i)
+    (format nil "rep-test-symbol-%d" i))
+
+  (define (all-found-p ob)
+    (let loop ((i 0))
+      (cond ((= i symbol-count) t)
+	    ((not (find-symbol (symbol-name-for i) ob)) nil)
+	    (t (loop (1+ i))))))
+
+  (define (interning-self-test ob)
+    (let ((saved (or ob (obarray)))
+	  (symbols '()))
+      (do ((i 0 (1+ i)))
+	  ((= i symbol-count))
+	(setq symbols (cons (intern (symbol-name-for i) ob) symbols)))
+
+      ;; every symbol can be found, through the original vector too
+      (test (all-found-p ob))
+      (test (all-found-p saved))
+
+      ;; interning the same names again gives the same symbols
+      (test (let loop ((i (1- symbol-count))
+		       (rest symbols))
+	      (cond ((null rest) t)
+		    ((not (eq (intern (symbol-name-for i) saved) (car rest))) nil)
+		    (t (loop (1- i) (cdr rest))))))
+
+      (mapc (lambda (sym) (unintern sym ob)) symbols)
+      (test (not (find-symbol (symbol-name-for 0) ob)))
+      (test (not (find-symbol (symbol-name-for (1- symbol-count)) saved)))))
+
+  ;; the default obarray grows to keep its chains short, without
+  ;; changing the vector that `obarray' returns
+  (define (growth-self-test)
+    (let* ((saved (obarray))
+	   (before (nth 1 (obarray-statistics))))
+      (interning-self-test nil)
+      (test (eq (obarray) saved))
+      (test (> (nth 1 (obarray-statistics)) before))
+      (test (<= (nth 3 (obarray-statistics)) 16))
+      (test (equal (obarray-statistics) (obarray-statistics saved)))
+      (test (memq 'growth-self-test (apropos "^growth-self-test$")))))
+
+  (define property-count 20)
+
+  (define (property-for i)
+    (intern (format nil "rep-test-property-%d" i)))
+
+  (define (properties-p sym n #!optional removed)
+    (let loop ((i 0))
+      (cond ((= i n) t)
+	    ((not (eql (get sym (property-for i)) (if (eql i removed) nil i)))
+	     nil)
+	    (t (loop (1+ i))))))
+
+  ;; plists keep working as they grow past the size at which put
+  ;; starts indexing them, and when they're changed behind its back
+  (define (plist-self-test)
+    (let ((sym (make-symbol "rep-test-plist")))
+      (test (let loop ((i 0))
+	      (cond ((= i property-count) t)
+		    ((progn
+		       (put sym (property-for i) i)
+		       (not (properties-p sym (1+ i))))
+		     nil)
+		    (t (loop (1+ i))))))
+      (test (= (length (symbol-plist sym)) (* property-count 2)))
+
+      (put sym (property-for 3) 'changed)
+      (test (eq (get sym (property-for 3)) 'changed))
+      (put sym (property-for 3) 3)
+      (put sym "string" 'equal)
+      (test (eq (get sym (copy-sequence "string")) 'equal))
+      (test (null (get sym 'rep-test-no-such-property)))
+
+      ;; splicing a property out of the list that symbol-plist returns
+      (let ((plist (symbol-plist sym))
+	    (gone (property-for 5)))
+	(let loop ((rest plist))
+	  (when (consp (cddr rest))
+	    (if (eq (nth 2 rest) gone)
+		(rplacd (cdr rest) (nthcdr 4 rest))
+	      (loop (cddr rest)))))
+	(test (properties-p sym property-count 5))
+	(put sym (property-for 5) 5)
+	(test (properties-p sym property-count)))
+
+      ;; setplist replaces the list, and the index with it
+      (setplist sym (list 'a 1 'b 2))
+      (test (eql (get sym 'a) 1))
+      (test (null (get sym (property-for 0))))
+      (test (equal (symbol-plist sym) '(a 1 b 2)))
+      (setplist sym '())
+      (test (null (get sym 'a)))))
+
+  (define (self-test)
+    (growth-self-test)
+    (interning-self-test (make-obarray 17))
+    (plist-self-test))
+
+  ;;###autoload
+  (define-self-test 'rep.lang.symbols self-test))
@@ -0,0 +1,157 @@
+#| rep.test.tables -- checks for rep.data.tables module
+
+   $Id$
+
+   This file is part of librep.
+
+   librep is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   librep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with librep; see the file COPYING.  If not, write to
+   the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+|#
+
+(define-structure rep.data.tables.self-tests ()
+
+    (open rep
+	  rep.data.tables
+	  rep.test.framework)
+
+  ;; tables of 1024 slots or more are resized a few slots at a time;
+  ;; this many entries makes a 1024-slot table grow
+  (define resize-count 769)
+
+  (define (all-present-p tab from to)
+    (let loop ((i from))
+      (cond ((>= i to) t)
+	    ((not (table-bound-p tab i)) nil)
+	    (t (loop (+ i 2))))))
+
+  (define (resize-self-test)
+    ;; a constant hash makes one long run of entries, which wraps
+    ;; around the end of the array for some of these home slots
+    (do ((h 0 (1+ h)))
+	((= h 8))
+      (let ((tab (make-table (lambda (x) (declare (unused x)) h) eq)))
+	(do ((i 0 (1+ i)))
+	    ((= i resize-count))
+	  (table-set tab i t))
+	(test (all-present-p tab 0 resize-count))
+	(test (all-present-p tab 1 resize-count)))
+
+      ;; removing entries while the resize is still in progress
+      (let ((tab (make-table (lambda (x) (declare (unused x)) h) eq)))
+	(do ((i 0 (1+ i)))
+	    ((= i resize-count))
+	  (table-set tab i t))
+	(do ((i 0 (+ i 2)))
+	    ((>= i resize-count))
+	  (table-unset tab i))
+	(test (all-present-p tab 1 resize-count))
+	(test (not (table-bound-p tab 0)))
+	(test (not (table-bound-p tab (1- resize-count))))))
+
+    ;; every key is found after each step of a resize
+    (let ((tab (make-table equal-hash equal)))
+      (do ((i 0 (1+ i)))
+	  ((= i 3000))
+	(table-set tab i (* i i)))
+      (test (let loop ((i 0))
+	      (cond ((= i 3000) t)
+		    ((not (eql (table-ref tab i) (* i i))) nil)
+		    (t (loop (1+ i))))))))
+
+  (define (bad-key-p thunk)
+    (condition-case nil
+	(progn (thunk) nil)
+      (bad-arg t)))
+
+  (define (key-type-self-test)
+    (let ((strings (make-table string-hash string=))
+	  (symbols (make-table symbol-hash eq)))
+      (table-set strings "foo" 1)
+      (table-set symbols 'foo 1)
+      (test (bad-key-p (lambda () (table-set strings 'foo 2))))
+      (test (bad-key-p (lambda () (table-ref strings 42))))
+      (test (bad-key-p (lambda () (table-set symbols "foo" 2))))
+      (test (bad-key-p (lambda () (table-unset symbols 42))))
+      (test (eql (table-ref strings "foo") 1))
+      (test (eql (table-ref symbols 'foo) 1))))
+
+  (define (weak-self-test)
+    (let ((tab (make-weak-table equal-hash eq))
+	  (kept '()))
+      (do ((i 0 (1+ i)))
+	  ((= i 1000))
+	(let ((key (list i)))
+	  ;; values refer back to their keys, which mustn't keep them alive
+	  (table-set tab key (cons key i))
+	  (when (zerop (mod i 10))
+	    (setq kept (cons key kept)))))
+      (garbage-collect)
+      ;; allow for a few keys still being referenced from the stack
+      (test (< (table-size tab) 200))
+      (test (let loop ((rest kept))
+	      (cond ((null rest) t)
+		    ((not (eq (car (table-ref tab (car rest))) (car rest))) nil)
+		    (t (loop (cdr rest))))))
+      ;; the remaining entries are all intact
+      (test (table-fold (lambda (k v ok)
+			  (and ok (eq (car v) k) (eql (cdr v) (car k))))
+			t tab))))
+
+  (define (make-number-table n)
+    (let ((tab (make-table eq-hash eq)))
+      (do ((i 0 (1+ i)))
+	  ((= i n) tab)
+	(table-set tab i i))))
+
+  (define (iteration-self-test)
+    ;; folding while removing each entry as it's seen
+    (let ((tab (make-number-table 2000)))
+      (test (= (table-fold (lambda (k v acc)
+			     (table-unset tab k)
+			     (+ acc v))
+			   0 tab)
+	       (/ (* 2000 1999) 2)))
+      (test (zerop (table-size tab))))
+
+    ;; the same with a cursor
+    (let ((tab (make-number-table 2000))
+	  (seen (make-table eq-hash eq))
+	  (cur nil)
+	  (next nil))
+      (setq cur (table-cursor tab))
+      (while (setq next (table-cursor-next cur))
+	(test (not (table-bound-p seen (car next))))
+	(table-set seen (car next) t)
+	(table-unset tab (car next)))
+      (test (= (table-size seen) 2000))
+      (test (zerop (table-size tab))))
+
+    ;; a cursor created during a resize still sees every entry
+    (let ((tab (make-number-table 780))
+	  (count 0)
+	  (cur nil))
+      (setq cur (table-cursor tab))
+      (while (table-cursor-next cur)
+	(setq count (1+ count)))
+      (test (= count 780))
+      (test (null (table-cursor-next cur)))))
+
+  (define (self-test)
+    (resize-self-test)
+    (key-type-self-test)
+    (weak-self-test)
+    (iteration-self-test))
+
+  ;;###autoload
+  (define-self-test 'rep.data.tables self-test))
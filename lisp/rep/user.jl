@@ -33,7 +33,7 @@
   (defun do-load (name)
     (cond ((file-exists-p name)
 	   (load name nil t t))
-	  ((string-match "\\.jlc?$" name)
+	  ((string-match "\\.jl[bc]?$" name)
 	   (load name))
 	  (t (require (intern name)))))
 
@@ -90,6 +90,7 @@
 					  (and input
 					       (not (string= "" input))))))))
 		      (let ((result (repl-eval form)))
+			(check-inlined-redefinition form)
 			(unless (eq result #undefined)
 			  (format standard-output "%S\n" result))))))
 		t)
@@ -97,6 +98,20 @@
 	     (default-error-handler (car data) (cdr data))
 	     t))))))
 
+  ;; the compiler may open-code small private functions into their
+  ;; callers (recording which in the `inlined-functions' property of
+  ;; the module name), warn when FORM redefines one of these
+  (define (check-inlined-redefinition form)
+    (let* ((struct (repl-struct (fluid current-repl)))
+	   (var (and (memq (car form) '(define defun defsubst setq))
+		     (if (consp (cadr form)) (caadr form) (cadr form))))
+	   (callers (and var (symbolp struct)
+			 (cdr (assq var (get struct 'inlined-functions))))))
+      (when callers
+	(format standard-error
+		"Warning: `%s' was inlined into %s, reload `%s' to update them\n"
+		var callers struct))))
+
   (define (do-readline prompt completer)
     (if (file-ttyp standard-input)
 	(progn
@@ -36,7 +36,7 @@
 
   ;; Instruction set version
   (defconst bytecode-major 11)
-  (defconst bytecode-minor 0)
+  (defconst bytecode-minor 2)
 
   ;; macro to get a named bytecode
   (defmacro bytecode (name)
@@ -218,6 +218,23 @@
       (optional-arg* . #xce)
       (keyword-arg* . #xcf)
 
+      (enclose-flat . #xd0)		;closure of stk[0] over a fresh env
+					; holding the n values below it
+
+      ;; variants emitted when the operand types are known
+      (fix-add . #xd1)			;fixnum arithmetic
+      (fix-sub . #xd2)
+      (fix-inc . #xd3)
+      (fix-dec . #xd4)
+      (fix-lt . #xd5)			;fixnum comparisons
+      (fix-gt . #xd6)
+      (fix-le . #xd7)
+      (fix-ge . #xd8)
+      (fix-num-eq . #xd9)
+      (cons-car . #xda)			;car/cdr of a cons
+      (cons-cdr . #xdb)
+      (vector-aref . #xdc)		;vector, fixnum index
+
       (last-before-jmps . #xf7)
 
 ;;; All jmps take two-byte arguments
@@ -267,8 +284,8 @@
      0   -1  0   -1  -1  0   0   nil
      -1  -2  -1  -1  0   0   -1  -2	;#xc0
      -1  +1  +1  +1  0   0   nil nil
-     nil nil nil nil nil nil nil nil	;#xd0
-     nil nil nil nil nil nil nil nil
+     nil -1  -1  0   0   -1  -1  -1	;#xd0
+     -1  -1  0   0   -1  nil nil nil
      -1  nil nil nil nil nil nil nil	;#xe0
      -1  nil nil nil nil nil nil nil
      nil nil nil nil nil nil nil nil	;#xf0
@@ -38,7 +38,9 @@
 ;;; Description of instruction set for when optimising
 
   ;; list of instructions that always have a 1-byte argument following them
-  (define byte-two-byte-insns (list (bytecode pushi)))
+  (define byte-two-byte-insns
+    (list (bytecode pushi)
+	  (bytecode enclose-flat)))
 
   ;; list of instructions that always have a 2-byte argument following them
   (define byte-three-byte-insns
@@ -60,7 +62,7 @@
       listp numberp stringp vectorp symbolp sequencep functionp
       special-form-p subrp eql macrop bytecodep caar cadr cdar
       cadddr caddddr cadddddr caddddddr cadddddddr scm-test
-      test-scm test-scm-f))
+      test-scm test-scm-f cons-car cons-cdr))
 
 
   ;; list of instructions that can be safely deleted if their result
@@ -70,7 +72,9 @@
 	      sub mul div rem lnot not lor land gt ge lt le inc dec ash
 	      boundp get reverse assoc assq rassoc rassq last copy-sequence
 	      lxor max min mod make-closure enclose quotient floor ceiling
-	      truncate round exp log sin cos tan sqrt expt structure-ref)
+	      truncate round exp log sin cos tan sqrt expt structure-ref
+	      fix-add fix-sub fix-inc fix-dec fix-lt fix-gt fix-le fix-ge
+	      fix-num-eq vector-aref)
            byte-varref-free-insns))
 
   ;; list of all conditional jumps
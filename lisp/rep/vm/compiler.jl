@@ -40,6 +40,8 @@
 	  rep.structures
 	  rep.system
 	  rep.io.files
+	  rep.io.processes
+	  rep.lang.doc
 	  rep.regexp
 	  rep.vm.compiler.basic
 	  rep.vm.compiler.bindings
@@ -66,6 +68,15 @@
   ;; regexp matching library files not to compile
   (define lib-exclude-re "\\bautoload\\.jl$|^CVS$")
 
+  (defvar *compiler-jobs* 1
+    "The number of files `compile-directory' compiles at once, each in
+its own rep process. When one, files are compiled in this process.")
+
+  (defvar *compiler-write-binary* t
+    "When true, `compile-file' also writes each compiled file in the
+binary format (`foo.jl' => `foo.jlb'), which loads faster than the
+printed `.jlc' file.")
+
   ;; map languages to compiler modules
   (put 'rep 'compiler-module 'rep.vm.compiler.rep)
   (put 'no-lang 'compiler-module 'rep.vm.compiler.no-lang)
@@ -217,6 +228,41 @@ we would like. This is due to the view of folded functions as
 (define (report-progress filename)
   (message (format nil "(compiling %s)" filename) t))
 
+;; Return a string identifying the contents of FILE-NAME: their length
+;; and MD5 digest. Returns nil if this can't be computed
+(define (source-hash file-name)
+  (condition-case nil
+      (progn
+	(require 'rep.util.md5)
+	(format nil "%x-%s" (file-size file-name)
+		(md5-local-file-hex (local-file-name file-name))))
+    (error nil)))
+
+;; Return the source hash written by compile-file near the start of
+;; the compiled file C-NAME, or nil if it doesn't have one
+(define (recorded-source-hash c-name)
+  (let ((file (open-file c-name 'read)))
+    (unwind-protect
+	(let loop ((line (read-line file))
+		   (count 0))
+	  (cond ((or (null line) (= count 16)) nil)
+		((string-looking-at ";; Source hash: ([0-9a-f-]+)" line)
+		 (expand-last-match "\\1"))
+		(t (loop (read-line file) (1+ count)))))
+      (close-file file))))
+
+;; Return true if the compiled version of FILE-NAME doesn't need to be
+;; remade. This compares the hash of the source with the one recorded
+;; when it was compiled, falling back to comparing modification times
+(define (compiled-file-up-to-date-p file-name)
+  (let ((c-name (concat file-name ?c)))
+    (and (file-exists-p c-name)
+	 (let* ((recorded (recorded-source-hash c-name))
+		(current (and recorded (source-hash file-name))))
+	   (if current
+	       (string= recorded current)
+	     (not (file-newer-than-file-p file-name c-name)))))))
+
 (defun compile-file (file-name)
   "Compiles the file of jade-lisp code FILE-NAME into a new file called
 `(concat FILE-NAME ?c)' (ie, `foo.jl' => `foo.jlc')."
@@ -224,7 +270,8 @@ we would like. This is due to the view of folded functions as
   (let ((temp-file (make-temp-name))
 	src-file dst-file body header)
     (let-fluids ((current-file file-name)
-		 (unsafe-for-call/cc nil))
+		 (unsafe-for-call/cc nil)
+		 (lazy-functions '()))
       (call-with-frame
        (lambda ()
 	 (unwind-protect
@@ -266,8 +313,12 @@ we would like. This is due to the view of folded functions as
 			     ;; write out the results
 			     (when header
 			       (write dst-file header))
-			     (format dst-file ";; Source file: %s\n(validate-byte-code %d %d)\n"
-				     file-name bytecode-major bytecode-minor)
+			     (format dst-file ";; Source file: %s\n" file-name)
+			     (let ((hash (source-hash file-name)))
+			       (when hash
+				 (format dst-file ";; Source hash: %s\n" hash)))
+			     (format dst-file "(validate-byte-code %d %d)\n"
+				     bytecode-major bytecode-minor)
 			     (mapc (lambda (form)
 				     (when form
 				       (print form dst-file))) body)
@@ -287,31 +338,162 @@ we would like. This is due to the view of folded functions as
 							  ?c ".jlc"))))
 		     (copy-file temp-file real-name)
 		     (set-file-modes real-name (file-modes file-name)))
+		   (when *compiler-write-binary*
+		     (write-binary-file file-name body
+					(fluid lazy-functions)))
 		   t)))
 	   (when (file-exists-p temp-file)
 	     (delete-file temp-file))))))))
 
+;; Write the compiled forms BODY of FILE-NAME to its `.jlb' file. LAZY
+;; is the list of defun bodies that needn't be decoded until called
+(define (write-binary-file file-name body lazy)
+  (let ((real-name (concat (if (string-match "\\.jl$" file-name)
+			       (substring file-name 0 (match-start))
+			     file-name) ".jlb")))
+    (write-compiled-forms real-name
+			  (cons (list 'validate-byte-code
+				      bytecode-major bytecode-minor)
+				(delq nil (copy-sequence body)))
+			  lazy)
+    (set-file-modes real-name (file-modes file-name))))
+
+;; Return the names of the structures opened or accessed by CONFIG,
+;; the configuration clause(s) of a define-structure form
+(define (config-dependencies config)
+  (when (symbolp (car config))
+    (setq config (list config)))
+  (let ((out '()))
+    (mapc (lambda (clause)
+	    (when (and (consp clause) (memq (car clause) '(open access)))
+	      (setq out (append (cdr clause) out))))
+	  config)
+    out))
+
+;; Return (NAME . DEPENDENCIES) for the structure defined by the file
+;; FILE-NAME, or nil if it doesn't start with a define-structure form
+(define (file-structure-dependencies file-name)
+  (let ((file (open-file file-name 'read)))
+    (unwind-protect
+	(condition-case nil
+	    (let loop ((form (read file)))
+	      (case (car form)
+		((declare) (loop (read file)))
+		((define-structure)
+		 (cons (nth 1 form) (config-dependencies (nth 3 form))))))
+	  (error nil))
+      (close-file file))))
+
+;; Compile FILES using up to JOBS rep processes at once. A file isn't
+;; started until the files in FILES defining the structures it opens or
+;; accesses have been compiled, so that it sees their compiled code.
+;; Each process writes its doc strings to a file of its own, these are
+;; merged into the real documentation file as the processes exit
+(define (compile-files-in-parallel files jobs)
+  (let* ((info (mapcar (lambda (file)
+			 (cons file (file-structure-dependencies file))) files))
+	 (defined (mapcar (lambda (x)
+			    (cons (cadr x) (car x))) (filter cdr info)))
+	 (pending (mapcar (lambda (x)
+			    (cons (car x)
+				  (delete (car x)
+					  (delq nil (mapcar
+						     (lambda (name)
+						       (cdr (assq name defined)))
+						     (cddr x))))))
+			  info))
+	 (running '())			;((PROCESS FILE OUTPUT DOC-FILE) ...)
+	 (finished '())
+	 (failed '()))
+
+    (define (ready-p job)
+      (let loop ((rest (cdr job)))
+	(cond ((null rest) t)
+	      ((member (car rest) finished) (loop (cdr rest)))
+	      (t nil))))
+
+    (define (next-job)
+      (or (let loop ((rest pending))
+	    (cond ((null rest) nil)
+		  ((ready-p (car rest)) (car rest))
+		  (t (loop (cdr rest)))))
+	  ;; if nothing is ready and nothing is running the remaining
+	  ;; files must depend on each other, so just pick one
+	  (and (null running) (car pending))))
+
+    (define (job-changed process)
+      (let ((job (assq process running)))
+	(when (and job (not (process-in-use-p process)))
+	  (setq running (delq job running))
+	  (setq finished (cons (nth 1 job) finished))
+	  (let ((output (get-output-stream-string (nth 2 job))))
+	    (unless (string= output "")
+	      (write standard-error output)))
+	  (unless (eql (process-exit-value process) 0)
+	    (setq failed (cons (nth 1 job) failed)))
+	  (when (and (nth 3 job) (file-exists-p (nth 3 job)))
+	    (doc-file-merge (nth 3 job))
+	    (delete-file (nth 3 job))))))
+
+    (define (start-job file)
+      (let* ((output (make-string-output-stream))
+	     (doc-file (and *compiler-write-docs* (make-temp-name)))
+	     (process (make-process output job-changed)))
+	(report-progress file)
+	(setq running (cons (list process file output doc-file) running))
+	(unless (apply start-process process program-name
+		       "--batch" "--no-rc" "-l" "rep.vm.compiler"
+		       "-f" "compile-batch"
+		       (nconc (and doc-file
+				   (list "--write-docs" "--doc-file" doc-file))
+			      (list file)))
+	  (error "Can't start rep process to compile %s" file))))
+
+    (while (or pending running)
+      (let (job)
+	(while (and (< (length running) jobs)
+		    (setq job (next-job)))
+	  (setq pending (delq job pending))
+	  (start-job (car job))))
+      (accept-process-output 1))
+    (when failed
+      (error "Failed to compile: %s" (nreverse failed)))))
+
+;; Return the Lisp files under DIR-NAME that need compiling, in the
+;; order they should be compiled
+(define (directory-sources dir-name force-p exclude-re)
+  (let ((out '()))
+    (let scan ((dir-name dir-name))
+      (mapc (lambda (file)
+	      (unless (or (and exclude-re (string-match exclude-re file))
+			  (eq (aref file 0) #\.))
+		(let ((abs-file (expand-file-name file dir-name)))
+		  (cond ((file-directory-p abs-file)
+			 (scan abs-file))
+			((and (string-match "\\.jl$" file)
+			      (or force-p
+				  (not (compiled-file-up-to-date-p abs-file))))
+			 (setq out (cons abs-file out)))))))
+	    (directory-files dir-name)))
+    (nreverse out)))
+
 (defun compile-directory (dir-name #!optional force-p exclude-re)
   "Compiles all Lisp files in the directory DIRECTORY-NAME whose object
-files are either older than their source file or don't exist. If
-FORCE-P is true every lisp file is recompiled. Any subdirectories of
-DIR-NAME are recursed into.
+files are either out of date or don't exist. If FORCE-P is true every
+lisp file is recompiled. Any subdirectories of DIR-NAME are recursed
+into.
+
+EXCLUDE-RE may be a regexp matching files which shouldn't be compiled.
 
-EXCLUDE-RE may be a regexp matching files which shouldn't be compiled."
+When `*compiler-jobs*' is greater than one, that many files are compiled
+in parallel by separate rep processes."
   (interactive "DDirectory of Lisp files to compile:\nP")
-  (mapc (lambda (file)
-	  (unless (or (and exclude-re (string-match exclude-re file))
-		      (eq (aref file 0) #\.))
-	    (let ((abs-file (expand-file-name file dir-name)))
-	      (cond ((file-directory-p abs-file)
-		     (compile-directory abs-file force-p exclude-re))
-		    ((string-match "\\.jl$" file)
-		     (let* ((c-name (concat abs-file ?c)))
-		       (when (or force-p (not (file-exists-p c-name))
-				 (file-newer-than-file-p abs-file c-name))
-			 (report-progress abs-file)
-			 (compile-file abs-file))))))))
-	(directory-files dir-name))
+  (let ((files (directory-sources dir-name force-p exclude-re)))
+    (if (> *compiler-jobs* 1)
+	(compile-files-in-parallel files *compiler-jobs*)
+      (mapc (lambda (file)
+	      (report-progress file)
+	      (compile-file file)) files)))
   t)
 
 (defun compile-lisp-lib (#!optional directory force-p)
@@ -324,8 +506,12 @@ that files which shouldn't be compiled aren't."
     (compile-directory (or directory lisp-lib-directory)
 		       force-p lib-exclude-re)))
 
-;; Call like `rep --batch -l compiler -f compile-lib-batch [--force] DIR'
+;; Call like `rep --batch -l compiler -f compile-lib-batch [--jobs N]
+;; [--force] DIR'
 (defun compile-lib-batch ()
+  (let ((jobs (get-command-line-option "--jobs" t)))
+    (when jobs
+      (setq *compiler-jobs* (string->number jobs))))
   (let ((force (when (equal (car command-line-args) "--force")
 		 (setq command-line-args (cdr command-line-args))
 		 t))
@@ -333,10 +519,14 @@ that files which shouldn't be compiled aren't."
     (setq command-line-args (cdr command-line-args))
     (compile-lisp-lib dir force)))
 
-;; Call like `rep --batch -l compiler -f compile-batch [--write-docs] FILES...'
+;; Call like `rep --batch -l compiler -f compile-batch [--write-docs]
+;; [--doc-file FILE] FILES...'
 (defun compile-batch ()
   (when (get-command-line-option "--write-docs")
     (setq *compiler-write-docs* t))
+  (let ((doc-file (get-command-line-option "--doc-file" t)))
+    (when doc-file
+      (setq documentation-file doc-file)))
   (while command-line-args
     (compile-file (car command-line-args))
     (setq command-line-args (cdr command-line-args))))
@@ -347,8 +537,7 @@ that files which shouldn't be compiled aren't."
 	    (let ((file (expand-file-name
 			 (concat (structure-file package) ".jl")
 			 lisp-lib-directory)))
-	      (when (or (not (file-exists-p (concat file ?c)))
-			(file-newer-than-file-p file (concat file ?c)))
+	      (unless (compiled-file-up-to-date-p file)
 		(report-progress file)
 		(compile-file file))))
 	  sources)))
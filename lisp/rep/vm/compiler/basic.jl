@@ -28,6 +28,7 @@
     (export current-file
 	    current-fun
 	    current-form
+	    lazy-functions
 	    lambda-records
 	    lambda-name lambda-args lambda-depth lambda-bindings
 	    lambda-bp lambda-sp
@@ -37,6 +38,7 @@
 	    current-lambda
 	    call-with-lambda-record
 	    assembly-code assembly-code-set
+	    assembly-max-stack assembly-max-stack-set
 	    assembly-slots assembly-slots-set
 	    compile-constant compile-form-1 compile-body
 	    compile-lambda compile-lambda-constant
@@ -63,9 +65,18 @@ their position in that file.")
 
   (defvar *compiler-debug* nil)
 
+  (defvar *compiler-report-optimisations* nil
+    "When t, the number of instructions removed from each compiled function
+by the low-level optimisers is printed to standard-error.")
+
+  (defvar *compiler-inline-limit* 16
+    "Largest size, in atoms, of a module-private function body that the
+compiler will open-code at its call sites. Zero disables this.")
+
   (define current-file (make-fluid))		;the file being compiled
   (define current-fun (make-fluid))		;the function being compiled
   (define current-form (make-fluid))		;the current cons-like form
+  (define lazy-functions (make-fluid '()))	;byte-code of top-level defuns
 
   (define-record-type :assembly
     (make-assembly code max-stack max-b-stack slots)
@@ -210,8 +221,10 @@ their position in that file.")
 
 		   ((and (symbolp fun)
 			 (cdr (assq fun (fluid inline-env)))
-			 (not (find-lambda fun)))
+			 (not (find-lambda fun))
+			 (inline-call-safe-p fun))
 		    ;; A call to a function that should be open-coded
+		    (note-inlined-call fun)
 		    (compile-lambda-inline (cdr (assq fun (fluid inline-env)))
 					   (cdr form) nil return-follows fun))
 		   (t
@@ -348,14 +361,39 @@ their position in that file.")
 	       (emit-insn '(return))
 	       (get-assembly)))))))))
 
+  ;; return the number of instructions (not labels) in CODE
+  (define (count-insns code)
+    (let loop ((rest code)
+	       (count 0))
+      (if (null rest)
+	  count
+	(loop (cdr rest) (if (consp (car rest)) (1+ count) count)))))
+
+  (define (run-peephole-optimizer asm)
+    (let ((tem (peephole-optimizer (assembly-code asm))))
+      (assembly-code-set asm (car tem))
+      (assembly-max-stack-set asm (+ (assembly-max-stack asm) (cdr tem)))))
+
   (define (optimize-assembly asm)
     (when *compiler-debug*
       (format standard-error "lap-0 code: %S\n\n" (assembly-code asm)))
     ;; Unless disabled, run the peephole optimiser
     (unless *compiler-no-low-level-optimisations*
-      (let ((tem (peephole-optimizer (assembly-code asm))))
-	(assembly-code-set asm (car tem))
-	(assembly-max-stack-set asm (+ (assembly-max-stack asm) (cdr tem)))))
+      (let ((before (count-insns (assembly-code asm)))
+	    after-peephole)
+	(run-peephole-optimizer asm)
+	(setq after-peephole (count-insns (assembly-code asm)))
+	;; then the basic block optimiser, tidying up after it
+	(assembly-code-set asm (block-optimizer (assembly-code asm)))
+	(run-peephole-optimizer asm)
+	(when *compiler-report-optimisations*
+	  (let ((after (count-insns (assembly-code asm))))
+	    (format standard-error
+		    "%s: %d instructions, %d removed by peephole, %d by blocks\n"
+		    (or (fluid current-fun) "<top-level>") after
+		    (- before after-peephole) (- after-peephole after)))))
+      ;; then use what's known about operand types
+      (specialize-types (assembly-code asm)))
     (when *compiler-debug*
       (format standard-error "lap-1 code: %S\n\n" (assembly-code asm))))
 
@@ -213,16 +213,31 @@
 	;; used to tag bindings unconditionally on the heap
 	(cell-tagged-p 'heap-allocated cell)))
 
-  ;; heap addresses count up from the _most_ recent binding
-  (define (heap-address var bindings)
+  ;; true if CELL is bound in BINDINGS above BASE
+  (define (local-binding-p cell bindings base)
+    (let loop ((rest bindings))
+      (cond ((or (null rest) (eq rest base)) nil)
+	    ((eq (car rest) cell) t)
+	    (t (loop (cdr rest))))))
+
+  ;; heap addresses count up from the _most_ recent binding. FLAT-MAP
+  ;; is an alist of (ENV . CELLS) for each enclosing flat closure, when
+  ;; ENV is reached the rest of the heap is the list of captured CELLS
+  (define (heap-address var bindings #!optional flat-map)
     (let loop ((rest bindings)
 	       (i 0))
-      (cond ((null rest) (error "No heap address for %s" var))
-	    ((or (not (heap-binding-p (car rest)))
-		 (cell-tagged-p 'no-location (car rest)))
-	     (loop (cdr rest) i))
-	    ((eq (caar rest) var) i)
-	    (t (loop (cdr rest) (1+ i))))))
+      (let ((flat (assq rest flat-map)))
+	(cond (flat
+	       (let ((tail (memq (assq var rest) (cdr flat))))
+		 (unless tail
+		   (error "No flat heap address for %s" var))
+		 (+ i (- (length (cdr flat)) (length tail)))))
+	      ((null rest) (error "No heap address for %s" var))
+	      ((or (not (heap-binding-p (car rest)))
+		   (cell-tagged-p 'no-location (car rest)))
+	       (loop (cdr rest) i))
+	      ((eq (caar rest) var) i)
+	      (t (loop (cdr rest) (1+ i)))))))
 
   ;; slot addresses count up from the _least_ recent binding
   (define (slot-address var bindings base)
@@ -238,21 +253,95 @@
 		     (t (loop-2 (cdr rest) (1+ i))))))
 	    (t (loop (cdr rest))))))
 
-  (define (identify-captured-bindings asm lex-env)
+  ;; (push-bytecode ASM ENV DOC INTERACTIVE [CELLS]), the fifth element
+  ;; is only present when the closure has been made flat
+  (define (flat-closure-insn-p insn) (consp (nthcdr 5 insn)))
+
+  ;; call (FUN INSN CELL) for each pseudo-instruction in ASM accessing
+  ;; a lexical binding, recursing into closures (but only into flat
+  ;; closures when INTO-FLAT is true)
+  (define (walk-lex-insns fun asm #!optional into-flat)
+    (mapc (lambda (insn)
+	    (case (car insn)
+	      ((lex-bind lex-ref lex-set)
+	       (fun insn (assq (nth 1 insn) (nth 2 insn))))
+	      ((push-bytecode)
+	       (when (or into-flat (not (flat-closure-insn-p insn)))
+		 (walk-lex-insns fun (nth 1 insn) into-flat)))))
+	  (assembly-code asm)))
+
+  (define (identify-captured-bindings asm lex-env #!optional cut)
     (mapc (lambda (insn)
 	    (case (car insn)
 	      ((lex-ref lex-set)
 	       (let ((cell (assq (nth 1 insn) lex-env)))
-		 (when cell
+		 ;; bindings below CUT are copied into a flat closure
+		 (when (and cell (not (memq cell cut)))
 		   (tag-cell 'captured cell))))
 	      ((push-bytecode)
-	       (identify-captured-bindings (nth 1 insn) (nth 2 insn)))))
+	       (identify-captured-bindings (nth 1 insn) (nth 2 insn)
+					   (if (flat-closure-insn-p insn)
+					       (nth 2 insn)
+					     cut)))))
 	  (assembly-code asm)))
 
+;; flat closures
+
+  ;; A closure whose free variables are never modified (after being
+  ;; bound) doesn't need to share the environment it was created in,
+  ;; it can be given a fresh environment containing only copies of
+  ;; the values it references. The enclosing function is then free
+  ;; to keep those variables in slots, and the closure doesn't keep
+  ;; any unrelated bindings alive.
+
+  ;; returns the list of binding cells from ENV referenced by ASM
+  (define (closure-free-cells asm env)
+    (let ((cells '()))
+      (walk-lex-insns (lambda (insn cell)
+			(declare (unused insn))
+			(when (and cell (memq cell env)
+				   (not (memq cell cells)))
+			  (setq cells (cons cell cells)))) asm)
+      (nreverse cells)))
+
+  ;; rewrite `push-bytecode; enclose' sequences in ASM (and in any
+  ;; nested closures) to `lex-ref...; push-bytecode; enclose-flat N'
+  ;; where possible. BOUND and MODIFIED list the cells that have been
+  ;; bound and set in the entire top-level function
+  (define (flatten-closures asm bound modified)
+    (let ((extra-stack 0))
+      (let loop ((rest (assembly-code asm))
+		 (out '()))
+	(if (null rest)
+	    (assembly-code-set asm (nreverse out))
+	  (let ((insn (car rest)))
+	    (if (not (eq (car insn) 'push-bytecode))
+		(loop (cdr rest) (cons insn out))
+	      (flatten-closures (nth 1 insn) bound modified)
+	      (let ((free (closure-free-cells (nth 1 insn) (nth 2 insn))))
+		(if (or (not (equal (cadr rest) '(enclose)))
+			(>= (length free) 256)
+			(let scan ((cells free))
+			  (cond ((null cells) nil)
+				((or (memq (car cells) modified)
+				     (not (memq (car cells) bound))) t)
+				(t (scan (cdr cells))))))
+		    (loop (cdr rest) (cons insn out))
+		  (setq extra-stack (max extra-stack (length free)))
+		  (loop (cddr rest)
+			(nconc (list (list 'enclose-flat (length free))
+				     (nconc insn (list free)))
+			       (nreverse
+				(mapcar (lambda (cell)
+					  (list 'lex-ref (car cell)
+						(nth 2 insn))) free))
+			       out))))))))
+      (assembly-max-stack-set asm (+ (assembly-max-stack asm) extra-stack))))
+
   ;; Extra pass over the output pseudo-assembly code; converts
   ;; pseudo-instructions accessing lexical bindings into real
   ;; instructions accessing either the heap or the slot registers
-  (define (allocate-bindings-1 asm base-env)
+  (define (allocate-bindings-1 asm base-env #!optional flat-map)
     (let ((max-slot 0))
       (let loop ((rest (assembly-code asm)))
 	(when rest
@@ -261,13 +350,16 @@
 	     (let* ((var (nth 1 (car rest)))
 		    (bindings (nth 2 (car rest)))
 		    (cell (assq var bindings)))
-	       (if (heap-binding-p cell)
+	       (if (or (heap-binding-p cell)
+		       (not (local-binding-p cell bindings base-env)))
 		   (rplaca rest (case (caar rest)
 				  ((lex-bind) (list 'bind))
 				  ((lex-ref)
-				   (list 'refn (heap-address var bindings)))
+				   (list 'refn (heap-address
+						var bindings flat-map)))
 				  ((lex-set)
-				   (list 'setn (heap-address var bindings)))))
+				   (list 'setn (heap-address
+						var bindings flat-map)))))
 		 (let ((slot (slot-address var bindings base-env)))
 		   (setq max-slot (max max-slot (1+ slot)))
 		   (rplaca rest (case (caar rest)
@@ -280,7 +372,11 @@
 		   (env (nth 2 (car rest)))
 		   (doc (nth 3 (car rest)))
 		   (interactive (nth 4 (car rest))))
-	       (allocate-bindings-1 asm env)
+	       (allocate-bindings-1 asm env
+				    (if (flat-closure-insn-p (car rest))
+					(cons (cons env (nth 5 (car rest)))
+					      flat-map)
+				      flat-map))
 	       (rplaca rest (list 'push (assemble-assembly-to-subr
 					 asm doc interactive))))))
 	  (loop (cdr rest))))
@@ -288,6 +384,14 @@
       asm))
 
   (define (allocate-bindings asm)
+    (let ((bound '())
+	  (modified '()))
+      (walk-lex-insns (lambda (insn cell)
+			(case (car insn)
+			  ((lex-bind) (setq bound (cons cell bound)))
+			  ((lex-set) (setq modified (cons cell modified)))))
+		      asm t)
+      (flatten-closures asm bound modified))
     (identify-captured-bindings asm (fluid lex-bindings))
     (allocate-bindings-1 asm (fluid lex-bindings)))
 
@@ -34,9 +34,12 @@
 	    push-state
 	    pop-state
 	    reload-state
-	    saved-state)
+	    saved-state
+	    specialize-types)
 
     (open rep
+	  rep.data.tables
+	  rep.vm.bytecodes
 	  rep.vm.compiler.utils
 	  rep.vm.compiler.bindings)
 
@@ -102,4 +105,442 @@
 	    (if (eq (car cell) lex-bindings)
 		(reload-lex-bindings (cdr cell))
 	      (fluid-set (car cell) (cdr cell))))
-	  (car (fluid saved-state)))))
+	  (car (fluid saved-state))))
+
+
+;;; Type specialization
+
+  ;; A forward pass over the finished lap code of a function that
+  ;; tracks what is known about the type of each stack entry and slot,
+  ;; then replaces generic instructions by variants that skip the type
+  ;; checks when their operands are known to be fixnums, conses or
+  ;; vectors. Types come from constants, from instructions whose result
+  ;; type is fixed, from consp/vectorp tests guarding a conditional
+  ;; jump, and from fixnum arithmetic whose operands are bounded well
+  ;; enough that it can't overflow. Nothing is assumed about arguments,
+  ;; so the only run-time checks left are the ones that established
+  ;; the types.
+
+  ;; Each stack entry is either () for nothing known, or (TYPE . SLOT)
+  ;; where TYPE is a type or a test result, and SLOT is the slot the
+  ;; value was loaded from (or ()). A type is cons, vector or a fixnum
+  ;; range (fixnum LO . HI). A test result is (test IF-TRUE . IF-FALSE)
+  ;; giving the type of slot SLOT when the value is true or false; each
+  ;; may be () for nothing learned.
+
+  ;; The bounds of a fixnum range are integers no larger than the
+  ;; smallest fixnum range of any host, or (max . K) or (min . K) for K
+  ;; less than the host's largest or more than its smallest fixnum. So
+  ;; the range of a fixnum whose value is unknown is (fixnum (min . 0)
+  ;; max . 0), and anything that could leave the range isn't a fixnum.
+  (define fixnum-max 536870911)
+  (define fixnum-min -536870912)
+  (define any-fixnum '(fixnum (min . 0) max . 0))
+
+  ;; (GENERIC SPECIALIZED OPERAND-TYPES...), operands deepest first
+  (define type-specializations
+    '((add fix-add fixnum fixnum)
+      (sub fix-sub fixnum fixnum)
+      (inc fix-inc fixnum)
+      (dec fix-dec fixnum)
+      (lt fix-lt fixnum fixnum)
+      (gt fix-gt fixnum fixnum)
+      (le fix-le fixnum fixnum)
+      (ge fix-ge fixnum fixnum)
+      (num-eq fix-num-eq fixnum fixnum)
+      (car cons-car cons)
+      (cdr cons-cdr cons)
+      (aref vector-aref vector fixnum)))
+
+  ;; instructions whose result always has a known type
+  (define type-results
+    `((length . ,(list* 'fixnum 0 '(max . 0))) (cons . cons)))
+
+  ;; type tests that can guard a jump
+  (define type-tests '((consp . cons) (vectorp . vector)))
+
+  ;; fixnum comparisons, and the operation narrowing the range of their
+  ;; first operand when the result is true and when it's false
+  (define range-tests
+    '((lt below . at-least) (fix-lt below . at-least)
+      (gt above . at-most) (fix-gt above . at-most)
+      (le at-most . above) (fix-le at-most . above)
+      (ge at-least . below) (fix-ge at-least . below)))
+
+  ;; the same, with the operands swapped
+  (define swapped-tests '((below . above) (above . below)
+			  (at-most . at-least) (at-least . at-most)))
+
+  (define (type-name type)
+    (cond ((symbolp type) type)
+	  ((eq (car type) 'fixnum) 'fixnum)))
+
+  (define (entry-type e) (type-name (car e)))
+
+  (define (test-entry-p e) (and (consp (car e)) (eq (car (car e)) 'test)))
+
+  (define (constant-type x)
+    (cond ((fixnump x)
+	   (if (and (>= x fixnum-min) (<= x fixnum-max))
+	       (list* 'fixnum x x)
+	     any-fixnum))
+	  ((consp x) 'cons)
+	  ((vectorp x) 'vector)))
+
+  (define (slot-type slots n) (cdr (assq n slots)))
+
+  (define (set-slot-type slots n type)
+    (let ((rest (filter (lambda (x) (/= (car x) n)) slots)))
+      (if type (cons (cons n type) rest) rest)))
+
+  (define (pop-n stack n)
+    (if (or (<= n 0) (null stack)) stack (pop-n (cdr stack) (1- n))))
+
+;;; Fixnum ranges
+
+  (define (range-lo type) (car (cdr type)))
+  (define (range-hi type) (cdr (cdr type)))
+
+  ;; Returns the bound B moved by the integer N, or () if it may
+  ;; leave the range of fixnums
+  (define (bound+ b n)
+    (cond ((integerp b)
+	   (let ((x (+ b n)))
+	     (and (>= x fixnum-min) (<= x fixnum-max) x)))
+	  ((eq (car b) 'max)
+	   (and (>= (cdr b) n) (cons 'max (- (cdr b) n))))
+	  (t (and (>= (+ (cdr b) n) 0) (cons 'min (+ (cdr b) n))))))
+
+  ;; true if bound A is certainly no greater than bound B
+  (define (bound<= a b)
+    (cond ((and (integerp a) (integerp b)) (<= a b))
+	  ;; the host's limits may be anywhere beyond the integers
+	  ((integerp a) (and (eq (car b) 'max) (<= a (- fixnum-max (cdr b)))))
+	  ((integerp b) (and (eq (car a) 'min) (>= b (+ fixnum-min (cdr a)))))
+	  ((eq (car a) (car b))
+	   (if (eq (car a) 'max) (>= (cdr a) (cdr b)) (<= (cdr a) (cdr b))))
+	  (t (eq (car a) 'min))))
+
+  (define (make-range lo hi) (and lo hi (list* 'fixnum lo hi)))
+
+  ;; the range of A + B, or () if it may overflow
+  (define (range-add a b)
+    (make-range
+     (cond ((integerp (range-lo b)) (bound+ (range-lo a) (range-lo b)))
+	   ((integerp (range-lo a)) (bound+ (range-lo b) (range-lo a))))
+     (cond ((integerp (range-hi b)) (bound+ (range-hi a) (range-hi b)))
+	   ((integerp (range-hi a)) (bound+ (range-hi b) (range-hi a))))))
+
+  ;; the range of -A, or () if it may overflow
+  (define (range-negate a)
+    (define (negate b)
+      (cond ((integerp b) (and (>= (- b) fixnum-min) (<= (- b) fixnum-max)
+			       (- b)))
+	    ((eq (car b) 'max) (cons 'min (1+ (cdr b))))
+	    ((> (cdr b) 0) (cons 'max (1- (cdr b))))))
+    (make-range (negate (range-hi a)) (negate (range-lo a))))
+
+  (define (range-sub a b)
+    (let ((neg (range-negate b)))
+      (and neg (range-add a neg))))
+
+  ;; the range of A knowing that A and B are related by OP, one of
+  ;; below, above, at-most or at-least
+  (define (narrow-range a b op)
+    (let ((lo (range-lo a))
+	  (hi (range-hi a)))
+      (case op
+	((below at-most)
+	 (let ((limit (if (eq op 'below)
+			  (bound+ (range-hi b) -1)
+			(range-hi b))))
+	   (when (and limit (not (bound<= hi limit)) (bound<= limit hi))
+	     (setq hi limit))))
+	((above at-least)
+	 (let ((limit (if (eq op 'above)
+			  (bound+ (range-lo b) 1)
+			(range-lo b))))
+	   (when (and limit (not (bound<= limit lo)) (bound<= lo limit))
+	     (setq lo limit)))))
+      (list* 'fixnum lo hi)))
+
+  ;; join the range OLD at a label with NEW reaching it. When WIDEN, a
+  ;; bound that isn't stable moves out to the next of the integers
+  ;; THRESHOLDS (in ascending order), or else to the limit, so that
+  ;; loops terminate
+  (define (join-ranges old new widen thresholds)
+    (let ((lo-old (range-lo old)) (lo-new (range-lo new))
+	  (hi-old (range-hi old)) (hi-new (range-hi new)))
+      (list* 'fixnum
+	     (cond ((bound<= lo-old lo-new) lo-old)
+		   ((not widen)
+		    (if (bound<= lo-new lo-old) lo-new '(min . 0)))
+		   (t (let loop ((rest (reverse thresholds)))
+			(cond ((null rest) '(min . 0))
+			      ((bound<= (car rest) lo-new) (car rest))
+			      (t (loop (cdr rest)))))))
+	     (cond ((bound<= hi-new hi-old) hi-old)
+		   ((not widen)
+		    (if (bound<= hi-old hi-new) hi-new '(max . 0)))
+		   (t (let loop ((rest thresholds))
+			(cond ((null rest) '(max . 0))
+			      ((bound<= hi-new (car rest)) (car rest))
+			      (t (loop (cdr rest))))))))))
+
+  ;; add the integer X to the ascending list LST, unless it's there
+  (define (insert-sorted x lst)
+    (cond ((or (null lst) (< x (car lst))) (cons x lst))
+	  ((= x (car lst)) lst)
+	  (t (cons (car lst) (insert-sorted x (cdr lst))))))
+
+  ;; a state is (STACK . SLOTS) with the stack top first; SLOTS is an
+  ;; alist of slots with known types. OLD is the state already recorded
+  ;; at a label, NEW another reaching it; WIDEN is true if the label
+  ;; starts a loop
+  (define (join-states old new widen thresholds)
+    (define (join-types x y)
+      (cond ((equal x y) x)
+	    ((and (eq (type-name x) 'fixnum) (eq (type-name y) 'fixnum))
+	     (join-ranges x y widen thresholds))))
+    (cons (let loop ((x (car old)) (y (car new)) (out '()))
+	    (if (and x y)
+		(loop (cdr x) (cdr y)
+		      (cons (cond ((equal (car x) (car y)) (car x))
+				  ((and (car x) (car y)
+					(eql (cdr (car x)) (cdr (car y))))
+				   (let ((type (join-types (car (car x))
+							   (car (car y)))))
+				     (and type (cons type (cdr (car x)))))))
+			    out))
+	      (nreverse out)))
+	  (let loop ((rest (cdr old)) (out '()))
+	    (if (null rest)
+		(nreverse out)
+	      (let* ((other (assq (car (car rest)) (cdr new)))
+		     (type (and other (join-types (cdr (car rest))
+						  (cdr other)))))
+		(loop (cdr rest)
+		      (if type (cons (cons (car (car rest)) type) out) out)))))))
+
+  ;; slot N has been modified, forget anything that depends on the
+  ;; value it previously held
+  (define (forget-slot stack n)
+    (mapcar (lambda (e)
+	      (cond ((not (eql (cdr e) n)) e)
+		    ((entry-type e) (cons (car e) nil))))
+	    stack))
+
+  ;; refine STATE knowing that test entry E is true (if TRUTH) or false
+  (define (refine-state state e truth)
+    (if (or (not (test-entry-p e)) (not (cdr e)))
+	state
+      (let ((type (if truth (car (cdr (car e))) (cdr (cdr (car e)))))
+	    (n (cdr e)))
+	(if type
+	    (cons (mapcar (lambda (x)
+			    (if (and (eql (cdr x) n)
+				     (or (null (car x)) (entry-type x)))
+				(cons type n)
+			      x))
+			  (car state))
+		  (set-slot-type (cdr state) n type))
+	  state))))
+
+  ;; the test entry for comparing the fixnums A (the deeper operand)
+  ;; and B with the instruction OP, or ()
+  (define (range-test-entry a b op)
+    (let ((ops (cdr (assq op range-tests))))
+      (cond ((and (cdr a) (eq (entry-type a) 'fixnum)
+		  (eq (entry-type b) 'fixnum))
+	     (cons (list* 'test (narrow-range (car a) (car b) (car ops))
+			  (narrow-range (car a) (car b) (cdr ops)))
+		   (cdr a)))
+	    ((and (cdr b) (eq (entry-type a) 'fixnum)
+		  (eq (entry-type b) 'fixnum))
+	     (cons (list* 'test
+			  (narrow-range (car b) (car a)
+					(cdr (assq (car ops) swapped-tests)))
+			  (narrow-range (car b) (car a)
+					(cdr (assq (cdr ops) swapped-tests))))
+		   (cdr b))))))
+
+  ;; the entry for the result of fixnum arithmetic OP on the operands
+  ;; at the top of STACK, or ()
+  (define (arith-entry op stack)
+    (let ((a (if (memq op '(add sub fix-add fix-sub)) (cadr stack) (car stack)))
+	  (b (car stack)))
+      (when (and (eq (entry-type a) 'fixnum) (eq (entry-type b) 'fixnum))
+	(let ((type (case op
+		      ((inc fix-inc) (range-add (car a) '(fixnum 1 . 1)))
+		      ((dec fix-dec) (range-add (car a) '(fixnum -1 . -1)))
+		      ((add fix-add) (range-add (car a) (car b)))
+		      ((sub fix-sub) (range-sub (car a) (car b))))))
+	  (and type (cons type nil))))))
+
+  ;; Apply INSN to STATE. Returns (FALL-THROUGH-STATE (LABEL . STATE)...)
+  ;; where the fall through state is () if there's no fall through, or
+  ;; the symbol `unknown' if the instruction can't be analyzed
+  (define (type-transfer insn state)
+    (let ((stack (car state))
+	  (slots (cdr state))
+	  (op (car insn)))
+      (define (next stack) (list (cons stack slots)))
+      (cond
+       ((eq op 'slot-ref)
+	(next (cons (cons (slot-type slots (cadr insn)) (cadr insn)) stack)))
+       ((eq op 'slot-set)
+	(let ((n (cadr insn)))
+	  (list (cons (forget-slot (cdr stack) n)
+		      (set-slot-type slots n (and (entry-type (car stack))
+						  (car (car stack))))))))
+       ((eq op 'push)
+	(next (cons (cons (constant-type (cadr insn)) nil) stack)))
+       ((eq op 'push-label) (next (cons nil stack)))
+       ((eq op 'dup) (next (cons (car stack) stack)))
+       ((eq op 'swap)
+	(next (list* (cadr stack) (car stack) (cddr stack))))
+       ((eq op 'swap2)
+	(next (list* (cadr stack) (caddr stack) (car stack) (cdddr stack))))
+       ((eq op 'pop-all) (next '()))
+       ((memq op '(init-bind unbind)) (next stack))
+       ((assq op type-tests)
+	(let ((e (car stack)))
+	  (next (cons (and (cdr e) (cons (list* 'test
+						(cdr (assq op type-tests)) nil)
+					 (cdr e)))
+		      (cdr stack)))))
+       ((memq op '(not null))
+	(let ((e (car stack)))
+	  (next (cons (and (test-entry-p e)
+			   (cons (list* 'test (cdr (cdr (car e)))
+					(car (cdr (car e))))
+				 (cdr e)))
+		      (cdr stack)))))
+       ((assq op range-tests)
+	(next (cons (range-test-entry (cadr stack) (car stack) op)
+		    (cddr stack))))
+       ((memq op '(inc dec fix-inc fix-dec))
+	(next (cons (arith-entry op stack) (cdr stack))))
+       ((memq op '(add sub fix-add fix-sub))
+	(next (cons (arith-entry op stack) (cddr stack))))
+       ((assq op type-results)
+	(let ((delta (aref byte-insn-stack-delta (bytecode-ref op))))
+	  (next (cons (cons (cdr (assq op type-results)) nil)
+		      (pop-n stack (- 1 delta))))))
+       ((eq op 'jmp) (list nil (cons (cadr insn) state)))
+       ((eq op 'ejmp) (list nil (cons (cadr insn) (cons (cdr stack) slots))))
+       ((eq op 'return) (list nil))
+       ((memq op '(jn jt))
+	(let ((e (car stack))
+	      (popped (cons (cdr stack) slots)))
+	  (list (refine-state popped e (eq op 'jn))
+		(cons (cadr insn) (refine-state popped e (eq op 'jt))))))
+       ((memq op '(jnp jtp))
+	;; jumps leaving the value, or pops it and falls through
+	(let ((e (car stack)))
+	  (list (refine-state (cons (cdr stack) slots) e (eq op 'jnp))
+		(cons (cadr insn) (refine-state state e (eq op 'jtp))))))
+       ((memq op '(jpn jpt))
+	;; pops the value and jumps, or falls through leaving it
+	(let ((e (car stack)))
+	  (list (refine-state state e (eq op 'jpn))
+		(cons (cadr insn) (refine-state (cons (cdr stack) slots)
+						e (eq op 'jpt))))))
+       ((eq op 'call) (next (cons nil (pop-n stack (1+ (cadr insn))))))
+       ((eq op 'enclose-flat) (next (cons nil (pop-n stack (1+ (cadr insn))))))
+       ((eq op 'optional-arg*) (next (list* nil nil stack)))
+       ((eq op 'keyword-arg*) (next (list* nil nil (cdr stack))))
+       (t
+	(let ((delta (aref byte-insn-stack-delta (bytecode-ref op))))
+	  (cond ((null delta) (list 'unknown))
+		((> delta 0) (next (cons nil stack)))
+		;; assume the worst: the instruction replaces all the
+		;; entries it touches by an unknown value
+		(t (next (cons nil (pop-n stack (- 1 delta)))))))))))
+
+  ;; Returns the specialized version of INSN given STATE, or ()
+  (define (specialize-insn insn state)
+    (let ((spec (assq (car insn) type-specializations)))
+      (when spec
+	(let loop ((types (reverse (cddr spec)))
+		   (stack (car state)))
+	  (cond ((null types) (list (cadr spec)))
+		((eq (car types) (entry-type (car stack)))
+		 (loop (cdr types) (cdr stack))))))))
+
+  ;; Run the analysis over CODE, then rewrite it in place. Returns the
+  ;; number of instructions that were specialized.
+  (define (specialize-types code)
+    (let ((states (make-table symbol-hash eq))
+	  (loop-heads (make-table symbol-hash eq))
+	  (thresholds '())
+	  (changed t)
+	  (count 0))
+
+      (define (merge label state)
+	(let ((old (table-ref states label)))
+	  (cond ((null old)
+		 (table-set states label state)
+		 (setq changed t))
+		((not (equal old state))
+		 (let ((new (join-states old state
+					 (table-ref loop-heads label)
+					 thresholds)))
+		   (unless (equal new old)
+		     (table-set states label new)
+		     (setq changed t)))))))
+
+      ;; Walk CODE calling (FUN INSN STATE) for each instruction
+      ;; reached (if FUN is non-nil), returning nil if an instruction
+      ;; can't be analyzed
+      (define (walk fun)
+	(let loop ((rest code)
+		   (state '(() . ())))
+	  (cond ((null rest) t)
+		((symbolp (car rest))
+		 (when state
+		   (merge (car rest) state))
+		 (loop (cdr rest) (table-ref states (car rest))))
+		((null state) (loop (cdr rest) nil))
+		(t
+		 (let ((out (type-transfer (car rest) state)))
+		   (unless (eq (car out) 'unknown)
+		     (when fun
+		       (fun (car rest) state))
+		     (mapc (lambda (x) (merge (car x) (cdr x))) (cdr out))
+		     (loop (cdr rest) (car out))))))))
+
+      ;; labels whose address is pushed are reached by the error
+      ;; handling code in the VM, with nothing known. Labels jumped to
+      ;; from later in the code start loops. Widening a range in a loop
+      ;; stops first at the constants of the function, or next to them,
+      ;; since those are the likely limits of its counters
+      (let ((seen (make-table symbol-hash eq)))
+	(mapc (lambda (insn)
+		(cond ((symbolp insn) (table-set seen insn t))
+		      ((and (cdr insn) (symbolp (cadr insn))
+			    (table-ref seen (cadr insn)))
+		       (table-set loop-heads (cadr insn) t))
+		      ((and (eq (car insn) 'push)
+			    (eq (type-name (constant-type (cadr insn)))
+				'fixnum))
+		       (mapc (lambda (x)
+			       (when (and (>= x fixnum-min) (<= x fixnum-max))
+				 (setq thresholds (insert-sorted x thresholds))))
+			     (list (1- (cadr insn)) (cadr insn)
+				   (1+ (cadr insn))))))
+		(when (and (consp insn) (eq (car insn) 'push-label))
+		  (table-set states (cadr insn) '(() . ()))))
+	      code))
+
+      ;; iterate until the state at each label is stable
+      (when (let loop ()
+	      (setq changed nil)
+	      (and (walk nil)
+		   (if changed (loop) t)))
+	(walk (lambda (insn state)
+		(let ((new (specialize-insn insn state)))
+		  (when new
+		    (rplaca insn (car new))
+		    (setq count (1+ count)))))))
+      count)))
@@ -33,6 +33,7 @@
 	    compiler-boundp
 	    compiler-binding-from-rep-p
 	    compiler-binding-immutable-p
+	    compiler-binding-private-p
 	    get-procedure-handler
 	    get-language-property
 	    compiler-macroexpand
@@ -70,6 +71,10 @@
 
   (define current-language (make-fluid 'rep))
 
+  ;; the names exported by the module being compiled, or t if these
+  ;; aren't known (outside a module definition, or with `export-all')
+  (define current-exports (make-fluid t))
+
   ;; the names of the currently open and accessed modules
   (define open-modules (make-fluid (and (fluid current-structure)
 					(structure-imports
@@ -169,6 +174,12 @@
 	   (and struct (binding-immutable-p (variable-stem var)
 					    (find-structure struct))))))
 
+  ;; return t if VAR is known not to be exported by the module being
+  ;; compiled, so that only code in this module can refer to it
+  (defun compiler-binding-private-p (var)
+    (let ((exports (fluid current-exports)))
+      (and (not (eq exports t)) (not (memq var exports)))))
+
   (defun get-language-property (prop)
     (and (fluid current-language) (get (fluid current-language) prop)))
 
@@ -221,6 +232,8 @@
 				     accessed))
 		 (const-env nil)
 		 (inline-env nil)
+		 (inline-free-vars nil)
+		 (inlined-calls nil)
 		 (defuns nil)
 		 (defvars (fluid defvars))
 		 (defines nil)
@@ -368,10 +381,15 @@
       (setq header (cons '(open rep.module-system) (nreverse header)))
 
       (let-fluids ((current-structure nil)
-		   (current-module name))
+		   (current-module name)
+		   (current-exports (if (assq 'export-all config)
+					t
+				      (condition-case nil
+					  (parse-interface sig)
+					(error t)))))
 	(call-with-module-env
 	 (lambda ()
-	   (setq body (compile-module-body-1 body))
+	   (setq body (record-inlined-calls name (compile-module-body-1 body)))
 
 	   (if top-level
 	       (if name
@@ -396,6 +414,15 @@
 	     (decrement-stack (if name 4 3))))
 	 opened accessed))))
 
+  ;; append a form to BODY recording which functions of the module
+  ;; called NAME had other functions of the module inlined into them,
+  ;; so that redefining those functions can be noticed
+  (defun record-inlined-calls (name body)
+    (if (and name (fluid inlined-calls) (compiler-binding-from-rep-p 'put))
+	(append body (list `(put ',name 'inlined-functions
+				 ',(fluid inlined-calls))))
+      body))
+
   (defun compile-structure-ref (form)
     (let
 	((struct (nth 1 form))
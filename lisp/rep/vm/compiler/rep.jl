@@ -67,7 +67,8 @@
 
 ;;; pass 1 support
 
-  (defun pass-1 (forms) (add-progns (pass-1* forms)))
+  (defun pass-1 (forms)
+    (add-progns (note-inline-candidates (pass-1* forms))))
 
   (defun pass-1* (forms) (lift-progns (mapcar do-pass-1 forms)))
 
@@ -152,6 +153,91 @@
 
       form))
 
+;;; automatic inlining
+
+  ;; symbols that may not appear in the body of a function inlined
+  ;; automatically, since they would define things at the call site
+  (define inline-definers
+    '(define defun defmacro defsubst defvar defconst %define define-macro
+      with-internal-definitions interactive))
+
+  ;; return the number of atoms in FORM
+  (defun form-size (form)
+    (cond ((consp form) (+ (form-size (car form)) (form-size (cdr form))))
+	  ((null form) 0)
+	  (t 1)))
+
+  ;; return the list of symbols occurring anywhere in FORM, added to OUT
+  (defun form-symbols (form #!optional out)
+    (cond ((consp form) (form-symbols (cdr form) (form-symbols (car form) out)))
+	  ((and form (symbolp form) (not (memq form out))) (cons form out))
+	  (t out)))
+
+  ;; add to inline-env the functions defined by top-level FORMS that
+  ;; are small enough to inline, don't call other functions defined by
+  ;; FORMS (so aren't recursive), and whose bindings can't change:
+  ;; either immutable, or private to the module and never assigned
+  (defun note-inline-candidates (forms)
+    (let ((defined '())
+	  (functions '())
+	  (duplicates '())
+	  (assigned '())
+	  (immutable '()))
+      (let scan ((form forms))
+	(when (consp form)
+	  (case (car form)
+	    ((setq)
+	     (do ((rest (cdr form) (cddr rest)))
+		 ((not (consp rest)))
+	       (setq assigned (cons (car rest) assigned))))
+	    ((make-binding-immutable)
+	     (when (eq (car (cadr form)) 'quote)
+	       (setq immutable (cons (cadr (cadr form)) immutable)))))
+	  (do ((rest form (cdr rest)))
+	      ((not (consp rest)))
+	    (scan (car rest)))))
+      (mapc (lambda (form)
+	      (when (memq (car form) '(defun defsubst defmacro %define))
+		(if (memq (cadr form) defined)
+		    (setq duplicates (cons (cadr form) duplicates))
+		  (setq defined (cons (cadr form) defined)))
+		(when (memq (car form) '(defun defsubst))
+		  (setq functions (cons (cadr form) functions)))))
+	    forms)
+      (unless (zerop *compiler-inline-limit*)
+	(mapc (lambda (form)
+		(let ((name (cadr form))
+		      (args (caddr form))
+		      (body (cdddr form)))
+		  (when (and (eq (car form) 'defun)
+			     (not (memq name duplicates))
+			     (not (assq name (fluid inline-env)))
+			     (or (memq name immutable)
+				 (and (compiler-binding-private-p name)
+				      (not (memq name assigned))))
+			     (listp args)
+			     (not (memq '#!key args))
+			     (<= (form-size body) *compiler-inline-limit*))
+		    (let ((symbols (form-symbols body)))
+		      (unless (catch 'out
+				(mapc (lambda (var)
+					(when (or (memq var functions)
+						  (memq var inline-definers))
+					  (throw 'out t)))
+				      symbols)
+				nil)
+			(fluid-set inline-env (cons (list* name 'lambda args body)
+						    (fluid inline-env)))
+			(fluid-set inline-free-vars
+				   (cons (cons name
+					       (let ((params (get-lambda-vars args)))
+						 (delete-if (lambda (var)
+							      (memq var params))
+							    symbols)))
+					 (fluid inline-free-vars))))))))
+	      forms))
+      forms))
+
 ;;; pass 2 support
 
   (defun pass-2 (forms)
@@ -171,9 +257,15 @@
 	     (when tmp
 	       (rplaca tmp nil)
 	       (rplacd tmp nil))
-	     (list 'defun (nth 1 form)
-		   (compile-lambda (cons 'lambda (nthcdr 2 form))
-				   (nth 1 form))))))
+	     ;; emit the expansion of the defun macro, so that loading
+	     ;; the file doesn't depend on the binding of `defun' then.
+	     ;; The code needn't be loaded until it's called
+	     (let ((code (compile-lambda (cons 'lambda (nthcdr 2 form))
+					 (nth 1 form))))
+	       (fluid-set lazy-functions (cons code (fluid lazy-functions)))
+	       (list '%define (nth 1 form)
+		     (list 'make-closure code
+			   (symbol-name (nth 1 form))))))))
 
 	((defmacro)
 	 (let ((code (compile-lambda (cons 'lambda (nthcdr 2 form))
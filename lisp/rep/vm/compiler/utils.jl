@@ -28,6 +28,7 @@
     (export current-stack max-stack
 	    current-b-stack max-b-stack
 	    const-env inline-env
+	    inline-free-vars inlined-calls
 	    defuns defvars defines
 	    output-stream
 	    silence-compiler
@@ -49,6 +50,8 @@
 	    compiler-constant-value
 	    constant-function-p
 	    constant-function-value
+	    inline-call-safe-p
+	    note-inlined-call
 	    note-declaration)
 
     (open rep
@@ -65,6 +68,9 @@
 
   (define const-env (make-fluid '()))		;alist of (NAME . CONST-DEF)
   (define inline-env (make-fluid '()))		;alist of (NAME . FUN-VALUE)
+  (define inline-free-vars (make-fluid '()))	;alist of (NAME SYMBOLS...)
+					; for functions inlined automatically
+  (define inlined-calls (make-fluid '()))	;alist of (NAME CALLERS...)
   (define defuns (make-fluid '()))		;alist of (NAME REQ OPT RESTP)
 					; for all functions/macros in the file
   (define defvars (make-fluid '()))		;all vars declared at top-level
@@ -369,6 +375,30 @@
 	 (nth 1 form))))
 
 
+;;; automatically inlined functions
+
+  ;; Return t if a call to the inline function NAME may be open-coded
+  ;; here. Functions chosen by the compiler itself (not `defsubst')
+  ;; are only inlined when none of the variables their bodies refer to
+  ;; is shadowed by a local binding at the call site
+  (defun inline-call-safe-p (name)
+    (let loop ((rest (cdr (assq name (fluid inline-free-vars)))))
+      (cond ((null rest) t)
+	    ((has-local-binding-p (car rest)) nil)
+	    (t (loop (cdr rest))))))
+
+  ;; Record that the body of NAME was inlined into the function being
+  ;; compiled, so that redefining NAME can be detected later
+  (defun note-inlined-call (name)
+    (when (and (assq name (fluid inline-free-vars)) (fluid current-fun))
+      (let ((cell (assq name (fluid inlined-calls))))
+	(cond ((null cell)
+	       (fluid-set inlined-calls (cons (list name (fluid current-fun))
+					      (fluid inlined-calls))))
+	      ((not (memq (fluid current-fun) (cdr cell)))
+	       (rplacd cell (cons (fluid current-fun) (cdr cell))))))))
+
+
 ;;; declarations
 
 (defun note-declaration (form)
@@ -76,8 +76,10 @@
      "test-scm" "test-scm-f" "%define" "spec-bind"	; #xc0
      "set" "required-arg" "optional-arg" "rest-arg"
      "not-zero-p" "keyword-arg" "optional-arg*" "keyword-arg*"
-     nil nil nil nil nil nil nil nil	; #xd0
-     nil nil nil nil nil nil nil nil
+     "enclose-flat\t#%d" "fix-add" "fix-sub" "fix-inc"	; #xd0
+     "fix-dec" "fix-lt" "fix-gt" "fix-le"
+     "fix-ge" "fix-num-eq" "cons-car" "cons-cdr"
+     "vector-aref" nil nil nil
      nil nil nil nil nil nil nil nil	; #xe0
      nil nil nil nil nil nil nil nil
      nil nil nil nil nil nil nil nil	; #xf0
@@ -143,6 +145,10 @@
 	  (when (>= arg 128)
 	    (setq arg (- (- 256 arg))))
 	  (format stream (aref disassembler-opcodes c) arg))
+	 ((= c (bytecode enclose-flat))
+	  (setq arg (aref code-string (1+ i)))
+	  (setq i (1+ i))
+	  (format stream (aref disassembler-opcodes c) arg))
 	 ((or (= c (bytecode pushi-pair-neg))
 	      (= c (bytecode pushi-pair-pos)))
 	  (setq arg (logior (ash (aref code-string (1+ i)) 8)
@@ -28,7 +28,8 @@
 
 (define-structure rep.vm.peephole
 
-    (export peephole-optimizer)
+    (export peephole-optimizer
+	    block-optimizer)
 
     (open rep
 	  rep.vm.bytecodes)
@@ -544,4 +545,163 @@
 	(shift))
 
       ;; drop the extra cons we added
-      (cons (cdr code-string) extra-stack))))
+      (cons (cdr code-string) extra-stack)))
+
+;;; basic block optimiser
+
+  ;; Unlike the peephole optimiser above, which only sees a window of
+  ;; three instructions, these passes work on the whole function split
+  ;; into basic blocks, each starting at a label or after a jump
+
+  ;; instructions that never continue with the next instruction
+  (define block-terminators '(jmp ejmp return))
+
+  ;; instructions that may be folded when their operands are constant:
+  ;; (INSN ARITY . FUNCTION)
+  (define foldable-insns
+    `((add 2 . ,+) (sub 2 . ,-) (mul 2 . ,*) (div 2 . ,/)
+      (rem 2 . ,%) (mod 2 . ,mod) (quotient 2 . ,quotient)
+      (lor 2 . ,logior) (land 2 . ,logand) (lxor 2 . ,logxor)
+      (ash 2 . ,ash) (max 2 . ,max) (min 2 . ,min)
+      (gt 2 . ,>) (ge 2 . ,>=) (lt 2 . ,<) (le 2 . ,<=) (num-eq 2 . ,=)
+      (equal 2 . ,equal) (eql 2 . ,eql)
+      (neg 1 . ,-) (inc 1 . ,1+) (dec 1 . ,1-) (lnot 1 . ,lognot)
+      (not 1 . ,not) (null 1 . ,null) (zerop 1 . ,zerop)
+      (atom 1 . ,atom) (consp 1 . ,consp) (listp 1 . ,listp)
+      (numberp 1 . ,numberp) (stringp 1 . ,stringp)
+      (vectorp 1 . ,vectorp) (symbolp 1 . ,symbolp)
+      (car 1 . ,car) (cdr 1 . ,cdr)))
+
+  ;; instructions that neither raise errors nor read slots, so can't
+  ;; observe a slot store before them being overwritten
+  (define store-transparent-insns '(push dup pop swap refn))
+
+  ;; split CODE into a list of basic blocks, each a list of instructions
+  ;; that may start with labels
+  (defun split-blocks (code)
+    (let loop ((rest code)
+	       (block '())
+	       (out '()))
+      (cond ((null rest)
+	     (nreverse (if block (cons (nreverse block) out) out)))
+	    ((and (symbolp (car rest)) block (not (symbolp (car block))))
+	     (loop rest '() (cons (nreverse block) out)))
+	    ((or (memq (caar rest) byte-jmp-insns)
+		 (eq (caar rest) 'return))
+	     (loop (cdr rest) '() (cons (nreverse (cons (car rest) block))
+					out)))
+	    (t (loop (cdr rest) (cons (car rest) block) out)))))
+
+  ;; return an alist mapping each label to the tail of BLOCKS that
+  ;; starts with the block it labels
+  (defun label-blocks (blocks)
+    (let loop ((rest blocks)
+	       (out '()))
+      (if (null rest)
+	  out
+	(loop (cdr rest)
+	      (let scan ((insns (car rest))
+			 (out out))
+		(if (symbolp (car insns))
+		    (scan (cdr insns) (cons (cons (car insns) rest) out))
+		  out))))))
+
+  ;; return the label that a jump to LABEL ends up at, skipping over
+  ;; blocks that contain nothing but an unconditional jump
+  (defun thread-jump (label labels)
+    (let loop ((label label)
+	       (seen '()))
+      (let ((insns (cadr (assq label labels))))
+	(while (and insns (symbolp (car insns)))
+	  (setq insns (cdr insns)))
+	(if (and (eq (caar insns) 'jmp)
+		 (not (memq (cadar insns) seen)))
+	    (loop (cadar insns) (cons label seen))
+	  label))))
+
+  ;; return the blocks of BLOCKS that can be reached from the first,
+  ;; either by falling through, by a jump, or as an error handler
+  (defun reachable-blocks (blocks labels)
+    (let ((reached '())
+	  (pending (list blocks)))
+      (while pending
+	(let ((rest (car pending)))
+	  (setq pending (cdr pending))
+	  (when (and rest (not (memq (car rest) reached)))
+	    (setq reached (cons (car rest) reached))
+	    (mapc (lambda (insn)
+		    (when (or (memq (car insn) byte-jmp-insns)
+			      (eq (car insn) 'push-label))
+		      (setq pending (cons (cdr (assq (cadr insn) labels))
+					  pending))))
+		  (car rest))
+	    (unless (memq (car (car (last (car rest)))) block-terminators)
+	      (setq pending (cons (cdr rest) pending))))))
+      (filter (lambda (block) (memq block reached)) blocks)))
+
+  ;; push A; [push B;] OP --> push (OP A [B])
+  (defun fold-constants (block)
+    (let loop ((rest block)
+	       (out '()))
+      (if (null rest)
+	  (nreverse out)
+	(let* ((folder (assq (caar rest) foldable-insns))
+	       (args (let scan ((prev out)
+				(args '()))
+		       (if (and folder (< (length args) (cadr folder))
+				(eq (caar prev) 'push))
+			   (scan (cdr prev) (cons (cadar prev) args))
+			 args)))
+	       (value (and folder (= (length args) (cadr folder))
+			   (condition-case nil
+			       (list (apply (cddr folder) args))
+			     (error nil)))))
+	  (if value
+	      (loop (cons (list 'push (car value)) (cdr rest))
+		    (nthcdr (cadr folder) out))
+	    (loop (cdr rest) (cons (car rest) out)))))))
+
+  ;; slot-set X --> pop, when slot X is never read, or when it's set
+  ;; again before anything could read it
+  (defun drop-dead-stores (block read-slots)
+    (do ((rest block (cdr rest)))
+	((null rest) block)
+      (when (and (eq (caar rest) 'slot-set)
+		 (or (not (memql (cadar rest) read-slots))
+		     (let scan ((next (cdr rest)))
+		       (cond ((equal (car next) (car rest)) t)
+			     ((or (memq (caar next) store-transparent-insns)
+				  (and (memq (caar next) '(slot-ref slot-set))
+				       (not (eql (cadar next) (cadar rest)))))
+			      (scan (cdr next)))
+			     (t nil)))))
+	(rplaca rest (list 'pop)))))
+
+  ;; run the basic block optimiser over CODE: threading jumps, deleting
+  ;; unreachable blocks, folding constants and dropping dead stores.
+  ;; Returns the new code
+  (defun block-optimizer (code)
+    (let* ((blocks (split-blocks code))
+	   (labels (label-blocks blocks))
+	   (read-slots '()))
+      (mapc (lambda (block)
+	      (mapc (lambda (insn)
+		      (when (memq (car insn) byte-jmp-insns)
+			(rplaca (cdr insn) (thread-jump (cadr insn) labels))))
+		    block))
+	    blocks)
+      (setq blocks (reachable-blocks blocks labels))
+      (mapc (lambda (block)
+	      (mapc (lambda (insn)
+		      (when (and (eq (car insn) 'slot-ref)
+				 (not (memql (cadr insn) read-slots)))
+			(setq read-slots (cons (cadr insn) read-slots))))
+		    block))
+	    blocks)
+      (let loop ((rest (nreverse blocks))
+		 (out '()))
+	(if (null rest)
+	    out
+	  (loop (cdr rest) (nconc (drop-dead-stores
+				   (fold-constants (car rest)) read-slots)
+				  out)))))))
@@ -22,7 +22,7 @@
 #define BYTECODES_H
 
 #define BYTECODE_MAJOR_VERSION 11
-#define BYTECODE_MINOR_VERSION 0
+#define BYTECODE_MINOR_VERSION 2
 
 /* Number of bits encoded in each extra opcode forming the argument. */
 #define ARG_SHIFT    8
@@ -267,6 +267,24 @@
 #define OP_OPTIONAL_ARG_ 0xce
 #define OP_KEYWORD_ARG_ 0xcf
 
+#define OP_ENCLOSE_FLAT 0xd0		/* fun = pop[1], env = (list pop[N]..),
+					   push (make-closure fun) with env */
+
+/* Variants of the generic instructions emitted when the compiler has
+   proved the types of their operands */
+#define OP_FIX_ADD 0xd1			/* fixnums, may still overflow */
+#define OP_FIX_SUB 0xd2
+#define OP_FIX_INC 0xd3
+#define OP_FIX_DEC 0xd4
+#define OP_FIX_LT 0xd5			/* compare two fixnums */
+#define OP_FIX_GT 0xd6
+#define OP_FIX_LE 0xd7
+#define OP_FIX_GE 0xd8
+#define OP_FIX_NUM_EQ 0xd9
+#define OP_CONS_CAR 0xda		/* car of a cons */
+#define OP_CONS_CDR 0xdb
+#define OP_VECTOR_AREF 0xdc		/* vector, fixnum index */
+
 
 /* Jump opcodes */
 
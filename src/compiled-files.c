@@ -0,0 +1,970 @@
+/* compiled-files.c -- binary format for files of compiled Lisp
+
+   $Id$
+
+   This file is part of librep.
+
+   librep is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   librep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with librep; see the file COPYING.  If not, write to
+   the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+/* Compiled files (.jlc) are printed Lisp, reading them back means
+   parsing every bytecode string and symbol name a character at a
+   time. The compiler also writes the same forms to a .jlb file in the
+   binary format described here, which `load' prefers when present.
+
+   All integers are four-byte big-endian values, except fixnums, which
+   take eight bytes. The file starts with MAGIC, then the header
+   fields (see enum below), then three sections:
+
+	symbols		for each symbol: the offset and length of its
+			name in the string pool, and its flags
+	strings		the string pool: symbol names, string constants
+			(bytecode included) and the printed form of any
+			object with no binary encoding
+	forms		the top-level forms, each a tree of objects
+
+   Each object is a tag byte followed by its operands:
+
+	n		nil
+	i N		the fixnum N
+	s I		entry I of the symbol table
+	" O L		the string of L bytes at offset O of the pool
+	l N ... T	a list of N elements, then its final cdr T
+	v N ...		a vector of N elements
+	b N ...		a byte-code subr of N slots
+	z N ...		as `b', but may be left undecoded until called
+	r O L		the object read from L bytes at offset O of the pool
+
+   The file is mapped into memory and decoded in place; symbols are
+   interned once each, not once per reference.
+
+   The compiler tags the byte-code of each top-level defun with `z',
+   and it's not decoded when the file is loaded. Such an object always
+   appears where it's evaluated, as the function given to make-closure,
+   so the loader reads it as `'STUB', where STUB is an autoload stub
+   holding the object's offset in the file. The byte-code is decoded
+   when the resulting closure is first called.
+   The file stays mapped until no such stubs remain. The compiler
+   writes files under a temporary name and renames them into place, so
+   the mapping normally outlives any recompilation; a file changed in
+   place is noticed before a stub is decoded, and the stub fails.  */
+
+#define _GNU_SOURCE
+
+#include "repint.h"
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+
+#ifdef HAVE_MMAP
+# include <sys/mman.h>
+#endif
+
+#define MAGIC "\177repjlb"
+#define MAGIC_LEN 8
+#define FORMAT_VERSION 2
+
+enum header_field {
+    h_version = 0,
+    h_symbol_count,
+    h_symbols,
+    h_strings_size,
+    h_strings,
+    h_form_count,
+    h_forms,
+    h_MAX
+};
+
+#define HEADER_SIZE (MAGIC_LEN + h_MAX * 4)
+
+/* Size of each symbol table entry */
+#define SYMBOL_SIZE 12
+
+/* Symbol flags */
+#define SYMBOL_KEYWORD 1
+
+DEFSTRING(invalid_file, "Invalid compiled file");
+DEFSTRING(write_error, "Can't write compiled file");
+
+
+/* Writing */
+
+typedef struct {
+    unsigned char *data;
+    size_t length, allocated;
+} buffer;
+
+typedef struct {
+    buffer symbols, strings, forms;
+    int symbol_count;
+
+    /* Open hash table mapping symbols to their index in the symbol
+       table, zero marks an empty slot. SIZE is always a power of two */
+    struct { repv symbol; int index; } *table;
+    int table_size;
+
+    repv lazy;				/* byte-code to tag with `z' */
+} writer;
+
+static void
+put_bytes (buffer *b, const void *data, size_t length)
+{
+    if (b->length + length > b->allocated)
+    {
+	size_t new_size = MAX (b->allocated * 2, b->length + length + 256);
+	b->data = rep_realloc (b->data, new_size);
+	b->allocated = new_size;
+    }
+    memcpy (b->data + b->length, data, length);
+    b->length += length;
+}
+
+static inline void
+put_byte (buffer *b, int x)
+{
+    unsigned char c = x;
+    put_bytes (b, &c, 1);
+}
+
+static void
+put_u32 (buffer *b, unsigned long x)
+{
+    unsigned char out[4];
+    out[0] = x >> 24; out[1] = x >> 16; out[2] = x >> 8; out[3] = x;
+    put_bytes (b, out, 4);
+}
+
+static void
+put_fixnum (buffer *b, long x)
+{
+    unsigned char out[8];
+    unsigned long u = x;
+    int i;
+    for (i = 7; i >= 0; i--)
+    {
+	out[i] = u & 255;
+	u = (u >> 4) >> 4;		/* longs may be only 32 bits */
+    }
+    put_bytes (b, out, 8);
+}
+
+/* Add LENGTH bytes from DATA to the string pool, then emit their
+   offset and length to the form section */
+static void
+put_pool_string (writer *w, const char *data, size_t length)
+{
+    put_u32 (&w->forms, w->strings.length);
+    put_u32 (&w->forms, length);
+    put_bytes (&w->strings, data, length);
+}
+
+static void
+grow_symbol_table (writer *w)
+{
+    int old_size = w->table_size, i;
+    void *old = w->table;
+    w->table_size = old_size ? old_size * 2 : 256;
+    w->table = rep_alloc (w->table_size * sizeof (w->table[0]));
+    memset (w->table, 0, w->table_size * sizeof (w->table[0]));
+    for (i = 0; i < old_size; i++)
+    {
+	repv sym = ((typeof (w->table)) old)[i].symbol;
+	if (sym != 0)
+	{
+	    int j = (sym >> 3) & (w->table_size - 1);
+	    while (w->table[j].symbol != 0)
+		j = (j + 1) & (w->table_size - 1);
+	    w->table[j] = ((typeof (w->table)) old)[i];
+	}
+    }
+    if (old != 0)
+	rep_free (old);
+}
+
+/* Return the index of SYM in the symbol table, adding it if necessary */
+static int
+symbol_index (writer *w, repv sym)
+{
+    int i;
+    repv name;
+
+    if (w->symbol_count * 2 >= w->table_size)
+	grow_symbol_table (w);
+
+    i = (sym >> 3) & (w->table_size - 1);
+    while (w->table[i].symbol != 0)
+    {
+	if (w->table[i].symbol == sym)
+	    return w->table[i].index;
+	i = (i + 1) & (w->table_size - 1);
+    }
+
+    name = rep_SYM (sym)->name;
+    put_u32 (&w->symbols, w->strings.length);
+    put_u32 (&w->symbols, rep_STRING_LEN (name));
+    put_u32 (&w->symbols, rep_KEYWORDP (sym) ? SYMBOL_KEYWORD : 0);
+    put_bytes (&w->strings, rep_STR (name), rep_STRING_LEN (name));
+
+    w->table[i].symbol = sym;
+    w->table[i].index = w->symbol_count;
+    return w->symbol_count++;
+}
+
+static rep_bool
+write_object (writer *w, repv obj)
+{
+    if (obj == Qnil)
+	put_byte (&w->forms, 'n');
+    else if (rep_INTP (obj))
+    {
+	put_byte (&w->forms, 'i');
+	put_fixnum (&w->forms, rep_INT (obj));
+    }
+    else if (rep_SYMBOLP (obj) && !rep_SYMBOL_LITERAL_P (obj))
+    {
+	put_byte (&w->forms, 's');
+	put_u32 (&w->forms, symbol_index (w, obj));
+    }
+    else if (rep_STRINGP (obj))
+    {
+	put_byte (&w->forms, '"');
+	put_pool_string (w, rep_STR (obj), rep_STRING_LEN (obj));
+    }
+    else if (rep_CONSP (obj))
+    {
+	repv tem;
+	int count = 0;
+	for (tem = obj; rep_CONSP (tem); tem = rep_CDR (tem))
+	    count++;
+	put_byte (&w->forms, 'l');
+	put_u32 (&w->forms, count);
+	for (; rep_CONSP (obj); obj = rep_CDR (obj))
+	{
+	    if (!write_object (w, rep_CAR (obj)))
+		return rep_FALSE;
+	}
+	return write_object (w, obj);
+    }
+    else if (rep_VECTORP (obj) || rep_COMPILEDP (obj))
+    {
+	int i, length = rep_VECT_LEN (obj);
+	int tag = 'v';
+	if (rep_COMPILEDP (obj))
+	{
+	    repv tem;
+	    tag = 'b';
+	    for (tem = w->lazy; rep_CONSP (tem); tem = rep_CDR (tem))
+	    {
+		if (rep_CAR (tem) == obj)
+		{
+		    tag = 'z';
+		    break;
+		}
+	    }
+	}
+	put_byte (&w->forms, tag);
+	put_u32 (&w->forms, length);
+	for (i = 0; i < length; i++)
+	{
+	    if (!write_object (w, rep_VECTI (obj, i)))
+		return rep_FALSE;
+	}
+    }
+    else
+    {
+	/* Anything else is stored as the reader would see it in a
+	   .jlc file */
+	repv stream = Fmake_string_output_stream (), string;
+	rep_print_val (stream, obj);
+	string = Fget_output_stream_string (stream);
+	if (string == rep_NULL || !rep_STRINGP (string))
+	    return rep_FALSE;
+	put_byte (&w->forms, 'r');
+	put_pool_string (w, rep_STR (string), rep_STRING_LEN (string));
+    }
+    return rep_TRUE;
+}
+
+static void
+free_writer (writer *w)
+{
+    if (w->symbols.data != 0)
+	rep_free (w->symbols.data);
+    if (w->strings.data != 0)
+	rep_free (w->strings.data);
+    if (w->forms.data != 0)
+	rep_free (w->forms.data);
+    if (w->table != 0)
+	rep_free (w->table);
+}
+
+DEFUN("write-compiled-forms", Fwrite_compiled_forms,
+      Swrite_compiled_forms, (repv file, repv forms, repv lazy), rep_Subr3) /*
+::doc:rep.io.files#write-compiled-forms::
+write-compiled-forms FILE FORMS [LAZY]
+
+Write the list of top-level Lisp forms FORMS to the file called FILE,
+in the binary format that `load' reads from `.jlb' files. FILE must be
+in the local filing system. Any existing FILE is replaced, not
+overwritten, so processes that have loaded it are unaffected.
+
+LAZY is a list of byte-code objects in FORMS that `load' needn't decode
+until they're called. Each must only appear in FORMS as an argument
+that is evaluated, and is then replaced by a quoted stub.
+::end:: */
+{
+    writer w;
+    buffer header;
+    repv local, temp, ret = Qt, tem;
+    rep_GC_root gc_file, gc_forms, gc_lazy;
+    FILE *fh;
+    int count = 0;
+
+    rep_DECLARE1 (file, rep_STRINGP);
+    rep_DECLARE2 (forms, rep_LISTP);
+
+    rep_PUSHGC (gc_file, file);
+    rep_PUSHGC (gc_forms, forms);
+    rep_PUSHGC (gc_lazy, lazy);
+    local = Flocal_file_name (file);
+    if (local == rep_NULL || !rep_STRINGP (local))
+    {
+	rep_POPGC; rep_POPGC; rep_POPGC;
+	return local ? rep_signal_file_error (file) : rep_NULL;
+    }
+
+    memset (&w, 0, sizeof (w));
+    w.lazy = lazy;
+    for (tem = forms; rep_CONSP (tem); tem = rep_CDR (tem))
+    {
+	if (!write_object (&w, rep_CAR (tem)))
+	{
+	    ret = rep_NULL;
+	    goto out;
+	}
+	count++;
+    }
+
+    memset (&header, 0, sizeof (header));
+    put_bytes (&header, MAGIC, MAGIC_LEN);
+    put_u32 (&header, FORMAT_VERSION);
+    put_u32 (&header, w.symbol_count);
+    put_u32 (&header, HEADER_SIZE);
+    put_u32 (&header, w.strings.length);
+    put_u32 (&header, HEADER_SIZE + w.symbols.length);
+    put_u32 (&header, count);
+    put_u32 (&header, HEADER_SIZE + w.symbols.length + w.strings.length);
+
+    /* Write to a new file then rename it over FILE. Loaded images
+       of the old file may still be mapped, they must not change */
+    temp = rep_concat2 (rep_STR (local), ".new");
+    fh = fopen (rep_STR (temp), "wb");
+    if (fh == 0)
+	ret = rep_signal_file_error (file);
+    else
+    {
+	if (fwrite (header.data, 1, header.length, fh) != header.length
+	    || fwrite (w.symbols.data, 1, w.symbols.length, fh) != w.symbols.length
+	    || fwrite (w.strings.data, 1, w.strings.length, fh) != w.strings.length
+	    || fwrite (w.forms.data, 1, w.forms.length, fh) != w.forms.length)
+	{
+	    ret = Fsignal (Qerror, rep_list_2 (rep_VAL (&write_error), file));
+	}
+	if (fclose (fh) != 0 && ret != rep_NULL)
+	    ret = Fsignal (Qerror, rep_list_2 (rep_VAL (&write_error), file));
+	rep_files_changed++;
+	if (ret != rep_NULL && rename (rep_STR (temp), rep_STR (local)) != 0)
+	    ret = rep_signal_file_error (file);
+	if (ret == rep_NULL)
+	    unlink (rep_STR (temp));
+    }
+    rep_free (header.data);
+
+out:
+    free_writer (&w);
+    rep_POPGC; rep_POPGC; rep_POPGC;
+    return ret;
+}
+
+
+/* Reading */
+
+/* A loaded file. Its data stays in memory while there are function
+   bodies in it that haven't been decoded yet */
+typedef struct image_struct image;
+struct image_struct {
+    repv car;
+    image *next;
+    unsigned char *data;		/* zero once released */
+    size_t length;
+    rep_bool mapped;
+    const unsigned char *strings;
+    unsigned long strings_size;
+    repv symbols;			/* vector of interned symbols */
+    repv file;
+    dev_t dev;				/* identity of the file when read */
+    ino_t ino;
+    time_t mtime;
+};
+
+#define IMAGEP(v)	rep_CELL16_TYPEP (v, image_type)
+#define IMAGE(v)	((image *) rep_PTR (v))
+
+static image *image_list;
+static int image_type;
+
+typedef struct {
+    image *img;
+    const unsigned char *ptr, *end;	/* current section */
+    rep_bool lazy;			/* leave defun bodies as stubs */
+    int stubs;
+} reader;
+
+static inline unsigned long
+get_u32_at (const unsigned char *p)
+{
+    return ((unsigned long) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static repv
+bad_file (reader *r)
+{
+    return Fsignal (Qerror, rep_list_2 (rep_VAL (&invalid_file),
+					r->img->file));
+}
+
+static rep_bool
+get_u32 (reader *r, unsigned long *out)
+{
+    if (r->end - r->ptr < 4)
+	return rep_FALSE;
+    *out = get_u32_at (r->ptr);
+    r->ptr += 4;
+    return rep_TRUE;
+}
+
+static repv
+get_pool_string (reader *r)
+{
+    unsigned long offset, length;
+    if (!get_u32 (r, &offset) || !get_u32 (r, &length)
+	|| offset > r->img->strings_size
+	|| length > r->img->strings_size - offset)
+    {
+	return bad_file (r);
+    }
+    return rep_string_dupn ((const char *) r->img->strings + offset, length);
+}
+
+/* Move R->ptr past the object it points to, without decoding it */
+static rep_bool
+skip_object (reader *r)
+{
+    unsigned long count, i;
+
+    if (r->ptr >= r->end)
+	return rep_FALSE;
+
+    switch (*r->ptr++)
+    {
+    case 'n':
+	return rep_TRUE;
+
+    case 'i': case '"': case 'r':
+	if (r->end - r->ptr < 8)
+	    return rep_FALSE;
+	r->ptr += 8;
+	return rep_TRUE;
+
+    case 's':
+	return get_u32 (r, &i);
+
+    case 'l':
+	if (!get_u32 (r, &count))
+	    return rep_FALSE;
+	count++;			/* the final cdr */
+	break;
+
+    case 'v': case 'b': case 'z':
+	if (!get_u32 (r, &count))
+	    return rep_FALSE;
+	break;
+
+    default:
+	return rep_FALSE;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+	if (!skip_object (r))
+	    return rep_FALSE;
+    }
+    return rep_TRUE;
+}
+
+static repv read_object (reader *r);
+
+/* R->ptr points at an object tagged `z'. Instead of decoding the
+   byte-code, return `'STUB', where STUB is `(autoload IMAGE . OFFSET)' */
+static repv
+read_lazy_function (reader *r)
+{
+    repv stub;
+    long offset = r->ptr - r->img->data;
+
+    if (!skip_object (r))
+	return bad_file (r);
+
+    stub = Fcons (Qautoload, Fcons (rep_VAL (r->img), rep_MAKE_INT (offset)));
+    r->stubs++;
+    return rep_list_2 (Qquote, stub);
+}
+
+/* Decode the object at R->ptr. There is no need to protect anything
+   from GC here, nothing is evaluated while the form is built */
+static repv
+read_object (reader *r)
+{
+    unsigned long count, i;
+    repv obj;
+
+    if (r->ptr >= r->end)
+	return bad_file (r);
+
+    switch (*r->ptr++)
+    {
+    case 'n':
+	return Qnil;
+
+    case 'i': {
+	unsigned long u = 0;
+	if (r->end - r->ptr < 8)
+	    return bad_file (r);
+	for (i = 0; i < 8; i++)
+	    u = (u << 4 << 4) | r->ptr[i];
+	r->ptr += 8;
+	return rep_MAKE_INT ((long) u);
+    }
+
+    case 's':
+	if (!get_u32 (r, &i) || i >= rep_VECT_LEN (r->img->symbols))
+	    return bad_file (r);
+	return rep_VECTI (r->img->symbols, i);
+
+    case '"':
+	return get_pool_string (r);
+
+    case 'l': {
+	repv head = Qnil, *tail = &head, tem;
+	if (!get_u32 (r, &count))
+	    return bad_file (r);
+	for (i = 0; i < count; i++)
+	{
+	    tem = read_object (r);
+	    if (tem == rep_NULL)
+		return rep_NULL;
+	    *tail = Fcons (tem, Qnil);
+	    tail = rep_CDRLOC (*tail);
+	}
+	tem = read_object (r);
+	if (tem == rep_NULL)
+	    return rep_NULL;
+	*tail = tem;
+	return head;
+    }
+
+    case 'z':
+	if (r->lazy)
+	{
+	    r->ptr--;
+	    return read_lazy_function (r);
+	}
+	/* fall through */
+
+    case 'v': case 'b': {
+	int compiled = r->ptr[-1] != 'v';
+	rep_bool lazy = r->lazy;
+	if (!get_u32 (r, &count) || count > (unsigned long) (r->end - r->ptr))
+	    return bad_file (r);
+	obj = rep_make_vector (count);
+	/* Nothing in a vector is evaluated */
+	r->lazy = rep_FALSE;
+	for (i = 0; i < count; i++)
+	{
+	    repv tem = read_object (r);
+	    if (tem == rep_NULL)
+	    {
+		r->lazy = lazy;
+		return rep_NULL;
+	    }
+	    rep_VECTI (obj, i) = tem;
+	}
+	r->lazy = lazy;
+	if (compiled)
+	{
+	    if (count < rep_COMPILED_MIN_SLOTS
+		|| !rep_STRINGP (rep_COMPILED_CODE (obj))
+		|| !rep_VECTORP (rep_COMPILED_CONSTANTS (obj))
+		|| !rep_INTP (rep_COMPILED_STACK (obj)))
+	    {
+		return bad_file (r);
+	    }
+	    rep_COMPILED (obj)->car = ((rep_COMPILED (obj)->car
+					& ~rep_CELL8_TYPE_MASK)
+				       | rep_Compiled);
+	}
+	return obj;
+    }
+
+    case 'r': {
+	repv string = get_pool_string (r), stream;
+	int c;
+	if (string == rep_NULL)
+	    return rep_NULL;
+	stream = Fcons (rep_MAKE_INT (0), string);
+	c = rep_stream_getc (stream);
+	return rep_readl (stream, &c);
+    }
+
+    default:
+	return bad_file (r);
+    }
+}
+
+/* Intern the symbols named by the symbol table */
+static rep_bool
+read_symbols (reader *r, unsigned long count)
+{
+    image *img = r->img;
+    unsigned long i;
+    img->symbols = Fmake_vector (rep_MAKE_INT (count), Qnil);
+    if (img->symbols == rep_NULL)
+    {
+	img->symbols = Qnil;
+	return rep_FALSE;
+    }
+    for (i = 0; i < count; i++)
+    {
+	unsigned long offset, length, flags;
+	repv name, sym;
+	if (!get_u32 (r, &offset) || !get_u32 (r, &length)
+	    || !get_u32 (r, &flags) || offset > img->strings_size
+	    || length > img->strings_size - offset)
+	{
+	    bad_file (r);
+	    return rep_FALSE;
+	}
+	name = rep_string_dupn ((const char *) img->strings + offset, length);
+	if (flags & SYMBOL_KEYWORD)
+	{
+	    sym = Fintern (name, rep_keyword_obarray);
+	    if (sym && rep_SYMBOLP (sym))
+		rep_SYM (sym)->car |= rep_SF_KEYWORD;
+	}
+	else
+	    sym = Fintern (name, Qnil);
+	if (sym == rep_NULL)
+	    return rep_FALSE;
+	rep_VECTI (img->symbols, i) = sym;
+    }
+    return rep_TRUE;
+}
+
+
+/* Images */
+
+static void
+release_image (image *img)
+{
+    if (img->data != 0)
+    {
+#ifdef HAVE_MMAP
+	if (img->mapped)
+	    munmap (img->data, img->length);
+	else
+#endif
+	    rep_free (img->data);
+	img->data = 0;
+    }
+}
+
+/* Map or read the local file FILE, returning a new image of it, or
+   rep_NULL after signalling an error */
+static repv
+make_image (repv file)
+{
+    image *img;
+    unsigned char *data = 0;
+    size_t length;
+    rep_bool mapped = rep_FALSE;
+    struct stat st;
+    int fd;
+
+    fd = open (rep_STR (file), O_RDONLY);
+    if (fd < 0 || fstat (fd, &st) != 0)
+    {
+	if (fd >= 0)
+	    close (fd);
+	return rep_signal_file_error (file);
+    }
+    length = st.st_size;
+
+#ifdef HAVE_MMAP
+    data = mmap (0, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED)
+	mapped = rep_TRUE;
+    else
+	data = 0;
+#endif
+    if (!mapped)
+    {
+	size_t done = 0;
+	data = rep_alloc (length);
+	while (data != 0 && done < length)
+	{
+	    ssize_t n = read (fd, data + done, length - done);
+	    if (n <= 0)
+		break;
+	    done += n;
+	}
+	if (data == 0 || done < length)
+	{
+	    close (fd);
+	    if (data != 0)
+		rep_free (data);
+	    return rep_signal_file_error (file);
+	}
+    }
+    close (fd);
+
+    img = rep_ALLOC_CELL (sizeof (image));
+    rep_data_after_gc += sizeof (image);
+    img->car = image_type;
+    img->data = data;
+    img->length = length;
+    img->mapped = mapped;
+    img->strings = 0;
+    img->strings_size = 0;
+    img->symbols = Qnil;
+    img->file = file;
+    img->dev = st.st_dev;
+    img->ino = st.st_ino;
+    img->mtime = st.st_mtime;
+    img->next = image_list;
+    image_list = img;
+    return rep_VAL (img);
+}
+
+static void
+image_mark (repv obj)
+{
+    rep_MARKVAL (IMAGE (obj)->symbols);
+    rep_MARKVAL (IMAGE (obj)->file);
+}
+
+static void
+image_sweep (void)
+{
+    image *x = image_list;
+    image_list = 0;
+    while (x != 0)
+    {
+	image *next = x->next;
+	if (!rep_GC_CELL_MARKEDP (rep_VAL (x)))
+	{
+	    release_image (x);
+	    rep_FREE_CELL (x);
+	}
+	else
+	{
+	    rep_GC_CLR_CELL (rep_VAL (x));
+	    x->next = image_list;
+	    image_list = x;
+	}
+	x = next;
+    }
+}
+
+static void
+image_print (repv stream, repv obj)
+{
+    rep_stream_puts (stream, "#<compiled-file ", -1, rep_FALSE);
+    rep_stream_puts (stream, rep_PTR (IMAGE (obj)->file), -1, rep_TRUE);
+    rep_stream_putc (stream, '>');
+}
+
+
+/* Loading */
+
+/* Return true if FILE (a local file name) starts with MAGIC */
+rep_bool
+rep_compiled_file_p (repv file)
+{
+    char buf[MAGIC_LEN];
+    rep_bool ret = rep_FALSE;
+    int fd = open (rep_STR (file), O_RDONLY);
+    if (fd >= 0)
+    {
+	ret = (read (fd, buf, MAGIC_LEN) == MAGIC_LEN
+	       && memcmp (buf, MAGIC, MAGIC_LEN) == 0);
+	close (fd);
+    }
+    return ret;
+}
+
+/* Evaluate each form of the binary compiled file FILE (a local file
+   name) in the current environment, returning the value of the last,
+   or rep_NULL if an error occurred. The byte-code of top-level defuns
+   is left in the file until it is first called */
+repv
+rep_load_compiled_file (repv file)
+{
+    reader r;
+    unsigned long header[h_MAX], i;
+    repv obj, result = rep_NULL;
+    rep_GC_root gc_obj;
+    image *img;
+
+    obj = make_image (file);
+    if (obj == rep_NULL)
+	return rep_NULL;
+    img = IMAGE (obj);
+    rep_PUSHGC (gc_obj, obj);
+
+    memset (&r, 0, sizeof (r));
+    r.img = img;
+
+    if (img->length < HEADER_SIZE
+	|| memcmp (img->data, MAGIC, MAGIC_LEN) != 0)
+    {
+	goto bad;
+    }
+    for (i = 0; i < h_MAX; i++)
+	header[i] = get_u32_at (img->data + MAGIC_LEN + i * 4);
+    if (header[h_version] != FORMAT_VERSION
+	|| header[h_symbols] > img->length
+	|| (header[h_symbol_count]
+	    > (img->length - header[h_symbols]) / SYMBOL_SIZE)
+	|| header[h_strings] > img->length
+	|| header[h_strings_size] > img->length - header[h_strings]
+	|| header[h_forms] > img->length)
+    {
+	goto bad;
+    }
+
+    img->strings = img->data + header[h_strings];
+    img->strings_size = header[h_strings_size];
+
+    r.ptr = img->data + header[h_symbols];
+    r.end = r.ptr + header[h_symbol_count] * SYMBOL_SIZE;
+    if (!read_symbols (&r, header[h_symbol_count]))
+	goto out;
+
+    r.ptr = img->data + header[h_forms];
+    r.end = img->data + img->length;
+    r.lazy = rep_TRUE;
+    result = Qnil;
+    for (i = 0; i < header[h_form_count]; i++)
+    {
+	repv form = read_object (&r);
+	rep_TEST_INT;
+	if (form == rep_NULL || rep_INTERRUPTP
+	    || !(result = rep_eval (form, Qnil)))
+	{
+	    result = rep_NULL;
+	    break;
+	}
+    }
+    goto out;
+
+bad:
+    bad_file (&r);
+    result = rep_NULL;
+
+out:
+    /* Nothing refers to the file's data, so free it now, not when
+       the image is next garbage collected */
+    if (r.stubs == 0)
+	release_image (img);
+    rep_POPGC;
+    return result;
+}
+
+/* Return true if FUN is a function body left in a compiled file */
+rep_bool
+rep_lazy_function_p (repv fun)
+{
+    return (rep_CONSP (fun) && rep_CAR (fun) == Qautoload
+	    && rep_CONSP (rep_CDR (fun)) && IMAGEP (rep_CAR (rep_CDR (fun))));
+}
+
+/* Return true if the file IMG was read from has been changed in place
+   since then. If it was replaced or deleted the old data is still
+   intact, whether mapped or not */
+static rep_bool
+image_changed_p (image *img)
+{
+    struct stat st;
+    if (!img->mapped || stat (rep_STR (img->file), &st) != 0)
+	return rep_FALSE;
+    return (st.st_dev == img->dev && st.st_ino == img->ino
+	    && ((size_t) st.st_size != img->length
+		|| st.st_mtime != img->mtime));
+}
+
+/* FUNARG is a closure whose function satisfies rep_lazy_function_p.
+   Decode the byte-code it refers to, and make it the closure's
+   function. Returns FUNARG, or rep_NULL if an error occurred */
+repv
+rep_load_lazy_function (repv funarg)
+{
+    repv def = rep_CDR (rep_FUNARG (funarg)->fun), fun;
+    unsigned long offset;
+    reader r;
+
+    memset (&r, 0, sizeof (r));
+    r.img = IMAGE (rep_CAR (def));
+    offset = rep_INT (rep_CDR (def));
+    if (r.img->data == 0 || offset >= r.img->length
+	|| image_changed_p (r.img) || r.img->data[offset] != 'z')
+    {
+	return bad_file (&r);
+    }
+    r.ptr = r.img->data + offset;
+    r.end = r.img->data + r.img->length;
+
+    fun = read_object (&r);
+    if (fun == rep_NULL)
+	return rep_NULL;
+    rep_FUNARG (funarg)->fun = fun;
+    rep_link_closure (funarg);
+    return funarg;
+}
+
+void
+rep_compiled_files_init (void)
+{
+    repv tem;
+    image_type = rep_register_new_type ("compiled-file", rep_ptr_cmp,
+					image_print, image_print,
+					image_sweep, image_mark,
+					0, 0, 0, 0, 0, 0, 0);
+    tem = rep_push_structure ("rep.io.files");
+    rep_ADD_SUBR(Swrite_compiled_forms);
+    rep_pop_structure (tem);
+}
@@ -677,7 +677,7 @@ primitive_call_cc (repv (*callback)(rep_continuation *, void *), void *data,
 	rep_saved_matches = c->regexp_data;
 	rep_gc_n_roots_stack = c->gc_n_roots;
 	rep_gc_root_stack = c->gc_roots;
-	rep_special_bindings = c->special_bindings;
+	rep_reroot_special_bindings (c->special_bindings);
 	rep_call_stack = c->call_stack;
 	root_barrier = c->root;
 	barriers = c->barriers;
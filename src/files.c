@@ -843,6 +843,8 @@ for ACCESS-TYPE requests. ACCESS-TYPE can be one of the symbols:
 						: "r")));
 	    if(rep_FILE(file)->file.fh == 0)
 		return rep_signal_file_error(file_name);
+	    if (access_type != Qread)
+		rep_files_changed++;
 	    rep_FILE(file)->handler = Qt;
 	    rep_FILE(file)->handler_data = file_name;
 	    if (access_type != Qwrite)
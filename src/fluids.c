@@ -27,31 +27,22 @@ DEFSYM (fluid, "fluid");
 /* XXX give fluids their own distinct type..? */
 
 #define FLUIDP(x) rep_CONSP(x)
-#define FLUID_GLOBAL_VALUE(x) rep_CDR(x)
 
+/* Fluids are shallow bound like special variables: the cdr of the
+   fluid always holds its current value, and each binding saves the
+   value it shadows on rep_special_bindings (see symbols.c). */
+#define FLUID_VALUE(x) rep_CDR(x)
 
-/* from symbols.c */
-
-static inline repv
-inlined_search_special_bindings (repv sym)
-{
-    register repv env;
-    for (env = rep_special_bindings; env != Qnil; env = rep_CDR (env))
-    {
-	if (rep_CAAR(env) == sym)
-	    return rep_CAR (env);
-    }
-    return Qnil;
-}
-
-static repv
-search_special_bindings (repv sym)
+/* Bind fluid F to V. The caller must mark the binding as a special
+   binding in its binding frame. Also used by OP_FLUID_BIND */
+void
+rep_bind_fluid (repv f, repv v)
 {
-    return inlined_search_special_bindings (sym);
+    rep_special_bindings = Fcons (Fcons (f, FLUID_VALUE (f)),
+				  rep_special_bindings);
+    FLUID_VALUE (f) = v;
 }
 
-
-
 DEFUN ("make-fluid", Fmake_fluid, Smake_fluid, (repv value), rep_Subr1) /*
 ::doc:rep.lang.interpreter#make-fluid::
 make-fluid [VALUE]
@@ -75,14 +66,8 @@ Return the value of the most recently created binding of the fluid
 variable object FLUID.
 ::end:: */
 {
-    repv tem;
     rep_DECLARE1(f, FLUIDP);
-
-    tem = search_special_bindings (f);
-    if (tem != Qnil)
-	return rep_CDR (tem);
-    else
-	return FLUID_GLOBAL_VALUE (f);
+    return FLUID_VALUE (f);
 }
 
 /* hardcoded in lispmach.c */
@@ -94,14 +79,8 @@ Set the value of the most recently created binding of the fluid
 variable object FLUID to VALUE.
 ::end:: */
 {
-    repv tem;
     rep_DECLARE1(f, FLUIDP);
-
-    tem = search_special_bindings (f);
-    if (tem != Qnil)
-	rep_CDR (tem) = v;
-    else
-	FLUID_GLOBAL_VALUE (f) = v;
+    FLUID_VALUE (f) = v;
     return v;
 }
 
@@ -133,13 +112,13 @@ signalled.
     {
 	repv f = rep_CAR (fluids), v = rep_CAR (values);
 	rep_DECLARE (1, f, FLUIDP (f));
-	rep_special_bindings = Fcons (Fcons (f, v), rep_special_bindings);
+	rep_bind_fluid (f, v);
 	fluids = rep_CDR (fluids);
 	values = rep_CDR (values);
 	rep_TEST_INT;
 	if (rep_INTERRUPTP)
 	{
-	    rep_special_bindings = old_bindings;
+	    rep_unwind_special_bindings (old_bindings);
 	    return rep_NULL;
 	}
     }
@@ -147,7 +126,7 @@ signalled.
     rep_PUSHGC (gc_old_bindings, old_bindings);
     ret = rep_call_lisp0 (thunk);
     rep_POPGC;
-    rep_special_bindings = old_bindings;
+    rep_unwind_special_bindings (old_bindings);
     return ret;
 }
 
@@ -704,11 +704,11 @@ read_vector(repv strm, int *c_p)
 	    {
 		repv nxt = rep_CDR(cur);
 		rep_VECT(result)->array[i] =  rep_CAR(cur);
-#if 1
-		/* I think it's okay to put the cons cells back onto their
-		   freelist. There can't be any references to them??  */
-		rep_cons_free(cur);
-#endif
+		/* Put the cons cells back onto their freelist. Not when
+		   origins are being recorded though, the origin guardian
+		   holds a reference to the head of the list.  */
+		if (!rep_record_origins)
+		    rep_cons_free(cur);
 		cur = nxt;
 	    }
 	}
@@ -1366,6 +1366,280 @@ out:
     }
 }
 
+/* Parsed lambda lists. The first time a lambda expression is applied
+   its parameter list is reduced to a vector,
+
+     [REQUIRED OPTIONAL KEY REST VARS... DEFAULTS... KEYWORDS...]
+
+   where REQUIRED, OPTIONAL and KEY count each kind of parameter, REST
+   is one if the last of VARS is a rest parameter, DEFAULTS are the
+   default value forms of the optional then the keyword parameters,
+   and KEYWORDS the keyword symbol of each keyword parameter. Later
+   calls bind their arguments straight from this vector. */
+
+#define DESC_REQUIRED(d) rep_INT (rep_VECTI (d, 0))
+#define DESC_OPTIONAL(d) rep_INT (rep_VECTI (d, 1))
+#define DESC_KEY(d) rep_INT (rep_VECTI (d, 2))
+#define DESC_REST(d) rep_INT (rep_VECTI (d, 3))
+#define DESC_NVARS(d) \
+    (DESC_REQUIRED (d) + DESC_OPTIONAL (d) + DESC_KEY (d) + DESC_REST (d))
+#define DESC_VAR(d,i) rep_VECTI (d, 4 + (i))
+#define DESC_DEFAULT(d,i) rep_VECTI (d, 4 + DESC_NVARS (d) + (i))
+#define DESC_KEYWORD(d,i) \
+    rep_VECTI (d, 4 + DESC_NVARS (d) + DESC_OPTIONAL (d) + DESC_KEY (d) + (i))
+
+/* Returns the descriptor of LAMBDA-LIST, or nil if it's malformed (in
+   which case bind_lambda_list_1 will signal the error when called) */
+static repv
+parse_lambda_list (repv lambdaList)
+{
+    enum arg_state {
+	STATE_REQUIRED = 0, STATE_OPTIONAL, STATE_KEY, STATE_REST
+    };
+
+    int count[4] = { 0, 0, 0, 0 };
+    enum arg_state state;
+    repv ptr, desc;
+    int i, pass;
+    rep_GC_root gc_lambdaList, gc_desc;
+
+    /* Pass 0 counts the parameters, pass 1 fills in the vector */
+    desc = Qnil;
+    rep_PUSHGC (gc_lambdaList, lambdaList);
+    rep_PUSHGC (gc_desc, desc);
+    for (pass = 0; pass < 2; pass++)
+    {
+	int index[4];
+	index[STATE_REQUIRED] = 0;
+	index[STATE_OPTIONAL] = count[STATE_REQUIRED];
+	index[STATE_KEY] = index[STATE_OPTIONAL] + count[STATE_OPTIONAL];
+	index[STATE_REST] = index[STATE_KEY] + count[STATE_KEY];
+
+	state = STATE_REQUIRED;
+	ptr = lambdaList;
+	while (1)
+	{
+	    repv argspec, var, def;
+
+	    if (rep_CONSP (ptr))
+	    {
+		argspec = rep_CAR (ptr);
+		ptr = rep_CDR (ptr);
+
+		if (argspec == ex_optional || argspec == Qamp_optional)
+		{
+		    static int dep;
+		    if (argspec == Qamp_optional && pass == 0)
+			rep_deprecated (&dep, "&optional in lambda list");
+		    if (state >= STATE_OPTIONAL)
+			goto invalid;
+		    state = STATE_OPTIONAL;
+		    continue;
+		}
+		else if (argspec == ex_key)
+		{
+		    if (state >= STATE_KEY)
+			goto invalid;
+		    state = STATE_KEY;
+		    continue;
+		}
+		else if (argspec == ex_rest || argspec == Qamp_rest)
+		{
+		    static int dep;
+		    if (argspec == Qamp_rest && pass == 0)
+			rep_deprecated (&dep, "&rest in lambda list");
+		    if (state >= STATE_REST)
+			goto invalid;
+		    state = STATE_REST;
+		    continue;
+		}
+	    }
+	    else if (ptr != Qnil && rep_SYMBOLP (ptr))
+	    {
+		state = STATE_REST;
+		argspec = ptr;
+		ptr = Qnil;
+	    }
+	    else
+		break;
+
+	    if (rep_SYMBOLP (argspec))
+	    {
+		var = argspec;
+		def = Qnil;
+	    }
+	    else if (rep_CONSP (argspec) && rep_SYMBOLP (rep_CAR (argspec)))
+	    {
+		var = rep_CAR (argspec);
+		def = rep_CONSP (rep_CDR (argspec)) ? rep_CADR (argspec) : Qnil;
+	    }
+	    else
+		goto invalid;
+
+	    if (pass == 0)
+		count[state]++;
+	    else
+	    {
+		i = index[state]++;
+		DESC_VAR (desc, i) = var;
+		if (state == STATE_OPTIONAL || state == STATE_KEY)
+		    DESC_DEFAULT (desc, i - count[STATE_REQUIRED]) = def;
+		if (state == STATE_KEY)
+		{
+		    repv key = Fmake_keyword (var);
+		    if (key == rep_NULL)
+		    {
+			desc = rep_NULL;
+			goto out;
+		    }
+		    DESC_KEYWORD (desc, (i - count[STATE_REQUIRED]
+					- count[STATE_OPTIONAL])) = key;
+		}
+	    }
+
+	    /* nothing after the rest parameter is looked at */
+	    if (state == STATE_REST)
+		break;
+	}
+
+	if (pass == 0)
+	{
+	    int nvars = (count[STATE_REQUIRED] + count[STATE_OPTIONAL]
+			 + count[STATE_KEY] + count[STATE_REST]);
+	    desc = Fmake_vector (rep_MAKE_INT (4 + nvars
+					       + count[STATE_OPTIONAL]
+					       + count[STATE_KEY] * 2), Qnil);
+	    if (desc == rep_NULL)
+		goto out;
+	    for (i = 0; i < 4; i++)
+		rep_VECTI (desc, i) = rep_MAKE_INT (count[i]);
+	}
+    }
+
+out:
+    rep_POPGC; rep_POPGC;
+    return desc;
+
+invalid:
+    rep_POPGC; rep_POPGC;
+    return Qnil;
+}
+
+/* Bind the NARGS values in ARGS to the parameters described by DESC,
+   with the same semantics as bind_lambda_list_1 */
+static repv
+bind_lambda_desc (repv desc, repv *args, int nargs)
+{
+    int nrequired = DESC_REQUIRED (desc);
+    int noptional = DESC_OPTIONAL (desc);
+    int nkey = DESC_KEY (desc);
+    int nvars = DESC_NVARS (desc);
+    repv *values = alloca (nvars * sizeof (repv) + 1);
+    char *evalp = alloca (nvars + 1);
+    int i, v = 0;
+
+    if (nargs < nrequired)
+    {
+	repv fun = rep_call_stack != 0 ? rep_call_stack->fun : Qnil;
+	return Fsignal (Qmissing_arg,
+			rep_list_2 (fun, DESC_VAR (desc, nargs)));
+    }
+
+    for (i = 0; i < nrequired; i++, v++)
+    {
+	values[v] = *args++;
+	evalp[v] = 0;
+    }
+    nargs -= nrequired;
+
+    for (i = 0; i < noptional; i++, v++)
+    {
+	if (nargs > 0)
+	{
+	    values[v] = *args++;
+	    evalp[v] = 0;
+	    nargs--;
+	}
+	else
+	{
+	    values[v] = DESC_DEFAULT (desc, i);
+	    evalp[v] = values[v] != Qnil;
+	}
+    }
+
+    for (i = 0; i < nkey; i++, v++)
+    {
+	repv key = DESC_KEYWORD (desc, i);
+	int j;
+	values[v] = DESC_DEFAULT (desc, noptional + i);
+	evalp[v] = values[v] != Qnil;
+	for (j = 0; j < nargs - 1; j++)
+	{
+	    if (args[j] == key && args[j+1] != rep_NULL)
+	    {
+		values[v] = args[j+1];
+		evalp[v] = 0;
+		args[j] = args[j+1] = rep_NULL;
+		break;
+	    }
+	}
+    }
+
+    if (DESC_REST (desc))
+    {
+	repv list = Qnil;
+	repv *ptr = &list;
+	while (nargs > 0)
+	{
+	    if (*args != rep_NULL)
+	    {
+		*ptr = Fcons (*args, Qnil);
+		ptr = rep_CDRLOC (*ptr);
+	    }
+	    args++; nargs--;
+	}
+	values[v] = list;
+	evalp[v++] = 0;
+    }
+
+    rep_TEST_INT;
+    if (rep_INTERRUPTP)
+	return rep_NULL;
+
+    /* evaluate any default values that are needed */
+    if (noptional + nkey > 0)
+    {
+	rep_GC_n_roots gc_values;
+	rep_GC_root gc_desc;
+	rep_PUSHGC (gc_desc, desc);
+	rep_PUSHGCN (gc_values, values, nvars);
+	for (i = 0; i < nvars; i++)
+	{
+	    if (evalp[i])
+	    {
+		repv tem = Feval (values[i]);
+		if (tem == rep_NULL)
+		{
+		    rep_POPGCN; rep_POPGC;
+		    return rep_NULL;
+		}
+		values[i] = tem;
+	    }
+	}
+	rep_POPGCN; rep_POPGC;
+    }
+
+    {
+	repv boundlist = rep_NEW_FRAME;
+	for (i = 0; i < nvars; i++)
+	{
+	    boundlist = rep_bind_symbol (boundlist, DESC_VAR (desc, i),
+					 values[i]);
+	}
+	return boundlist;
+    }
+}
+
 /* format of lambda-lists is something like,
 
    [<required-params>*] [#!optional <optional-param>*]
@@ -1377,13 +1651,16 @@ out:
    <optional-param> and <keyword-param> is either <symbol> or (<symbol>
    <default>) where <default> is a constant
 
-   Note that the lambdaList arg isn't protected from gc by this
-   function; it's assumed that this is done by the caller.
+   DESC is the parsed form of lambdaList made by parse_lambda_list, or
+   nil to parse the list as the arguments are bound.
+
+   Note that the lambdaList and desc args aren't protected from gc by
+   this function; it's assumed that this is done by the caller.
 
    IMPORTANT: this expects the top of the call stack to have the
    saved environments in which arguments need to be evaluated */
 static repv
-bind_lambda_list(repv lambdaList, repv argList)
+bind_lambda_list(repv lambdaList, repv desc, repv argList)
 {
     repv *argv;
     int argc;
@@ -1394,25 +1671,516 @@ bind_lambda_list(repv lambdaList, repv argList)
     /* Evaluate arguments, and stick them in the evalled_args array */
     copy_to_vector (argList, argc, argv);
 
-    return bind_lambda_list_1 (lambdaList, argv, argc);
+    if (desc != Qnil)
+	return bind_lambda_desc (desc, argv, argc);
+    else
+	return bind_lambda_list_1 (lambdaList, argv, argc);
+}
+
+/* Pre-analysis of interpreted lambda bodies.
+
+   The first time a lambda expression is applied its body is walked
+   once, expanding every macro call it contains (the body is copied
+   where it changes, the original list is never modified). The result
+   is cached against the (ARGS . BODY) part of the lambda expression
+   (which is shared by each closure `lambda' makes from it) and the
+   structure it is being evaluated in, so that later applications evaluate the
+   expanded code directly instead of going through `macroexpand' for
+   each `let', `if', `while', etc.
+
+   Only the seven special forms are understood; any other special form
+   is left as it is. Names bound by enclosing lambdas, or by the
+   closure's environment, are never treated as macros. Macros that
+   are still autoloads are not expanded (that would load their file
+   before it's needed), and if an expansion signals an error the call
+   is left for the evaluator to fail on, if it ever gets that far.
+
+   The cache is flushed lazily whenever a binding to or from a macro
+   is changed, or a name that has been bound to a macro may resolve
+   differently (see rep_macro_generation); stale entries are analysed
+   again from the lambda expression as it was written. If that happens
+   while a body is being evaluated, its remaining top-level forms are
+   evaluated as written. Entries whose lambda expression or structure
+   has become garbage are removed by the collector. */
+
+struct lambda_info {
+    struct lambda_info *next;
+    repv lambda;			/* (ARGS . BODY) of the lambda */
+    repv structure;
+    repv analysed;			/* analysed (ARGS . BODY) */
+    repv desc;				/* parsed ARGS, or rep_NULL */
+    repv source;			/* unanalysed lambda expression */
+    unsigned long generation;
+};
+
+static struct lambda_info **lambda_table;
+static int lambda_table_size, lambda_table_count;
+
+#define LAMBDA_HASH(l,s) \
+    ((((l) >> 3) ^ ((s) >> 5)) & (lambda_table_size - 1))
+
+static repv analyse_form (repv form, repv bound);
+
+static void
+enter_lambda_info (repv lambda, repv analysed, repv source)
+{
+    struct lambda_info *li;
+    unsigned int hash;
+
+    if (lambda_table_count >= lambda_table_size * 2)
+    {
+	int new_size = lambda_table_size ? lambda_table_size * 2 : 256, i;
+	struct lambda_info **new_table
+	    = rep_alloc (sizeof (struct lambda_info *) * new_size);
+	if (new_table == 0)
+	    return;
+	memset (new_table, 0, sizeof (struct lambda_info *) * new_size);
+	for (i = 0; i < lambda_table_size; i++)
+	{
+	    struct lambda_info *next;
+	    for (li = lambda_table[i]; li != 0; li = next)
+	    {
+		next = li->next;
+		hash = (((li->lambda >> 3) ^ (li->structure >> 5))
+			& (new_size - 1));
+		li->next = new_table[hash];
+		new_table[hash] = li;
+	    }
+	}
+	if (lambda_table != 0)
+	    rep_free (lambda_table);
+	lambda_table = new_table;
+	lambda_table_size = new_size;
+    }
+
+    lambda = rep_CDR (lambda);
+    hash = LAMBDA_HASH (lambda, rep_structure);
+    for (li = lambda_table[hash]; li != 0; li = li->next)
+    {
+	if (li->lambda == lambda && li->structure == rep_structure)
+	    break;
+    }
+    if (li == 0)
+    {
+	li = rep_alloc (sizeof (struct lambda_info));
+	if (li == 0)
+	    return;
+	li->lambda = lambda;
+	li->structure = rep_structure;
+	li->next = lambda_table[hash];
+	lambda_table[hash] = li;
+	lambda_table_count++;
+    }
+    li->analysed = analysed;
+    li->desc = rep_NULL;
+    li->source = source;
+    li->generation = rep_macro_generation;
+}
+
+/* Return a list of the parameter names in LAMBDA-LIST consed onto BOUND */
+static repv
+lambda_list_names (repv lambda_list, repv bound)
+{
+    while (rep_CONSP (lambda_list))
+    {
+	repv var = rep_CAR (lambda_list);
+	if (rep_CONSP (var))
+	    var = rep_CAR (var);
+	if (rep_SYMBOLP (var))
+	    bound = Fcons (var, bound);
+	lambda_list = rep_CDR (lambda_list);
+    }
+    if (rep_SYMBOLP (lambda_list) && lambda_list != Qnil)
+	bound = Fcons (lambda_list, bound);
+    return bound;
+}
+
+/* Analyse each element of LIST, returning LIST itself if nothing
+   changed, otherwise a fresh copy of it. */
+static repv
+analyse_list (repv list, repv bound)
+{
+    repv out = Qnil, ptr = list, result = list;
+    rep_bool changed = rep_FALSE;
+    rep_GC_root gc_list, gc_bound, gc_out, gc_ptr;
+
+    rep_PUSHGC (gc_list, list);
+    rep_PUSHGC (gc_bound, bound);
+    rep_PUSHGC (gc_out, out);
+    rep_PUSHGC (gc_ptr, ptr);
+    while (rep_CONSP (ptr))
+    {
+	repv form = analyse_form (rep_CAR (ptr), bound);
+	if (form == rep_NULL)
+	{
+	    result = rep_NULL;
+	    goto out;
+	}
+	if (form != rep_CAR (ptr))
+	    changed = rep_TRUE;
+	out = Fcons (form, out);
+	ptr = rep_CDR (ptr);
+    }
+    if (changed)
+    {
+	result = ptr;
+	while (rep_CONSP (out))
+	{
+	    repv next = rep_CDR (out);
+	    rep_CDR (out) = result;
+	    result = out;
+	    out = next;
+	}
+    }
+out:
+    rep_POPGC; rep_POPGC; rep_POPGC; rep_POPGC;
+    return result;
+}
+
+/* LAMBDA is `(lambda ARGS . BODY)', analyse BODY and record the result */
+static repv
+analyse_lambda (repv lambda, repv bound)
+{
+    repv body, result;
+    rep_GC_root gc_lambda;
+
+    if (!rep_CONSP (rep_CDR (lambda)))
+	return lambda;
+
+    rep_PUSHGC (gc_lambda, lambda);
+    bound = lambda_list_names (rep_CADR (lambda), bound);
+    body = analyse_list (rep_CDDR (lambda), bound);
+    if (body == rep_NULL)
+	result = rep_NULL;
+    else
+    {
+	if (body == rep_CDDR (lambda))
+	    result = lambda;
+	else
+	    result = Fcons (Qlambda, Fcons (rep_CADR (lambda), body));
+	enter_lambda_info (result, rep_CDR (result), lambda);
+    }
+    rep_POPGC;
+    return result;
+}
+
+static repv
+analyse_form (repv form, repv bound)
+{
+    repv car, value;
+
+again:
+    if (!rep_CONSP (form))
+	return form;
+
+    car = rep_CAR (form);
+    if (rep_CONSP (car) && rep_CAR (car) == Qlambda
+	&& Fsymbol_value (Qlambda, Qt) == rep_VAL (&Slambda))
+    {
+	/* inline lambda */
+	repv args;
+	rep_GC_root gc_form, gc_bound, gc_car;
+	rep_PUSHGC (gc_form, form);
+	rep_PUSHGC (gc_bound, bound);
+	rep_PUSHGC (gc_car, car);
+	car = analyse_lambda (car, bound);
+	args = car ? analyse_list (rep_CDR (form), bound) : rep_NULL;
+	rep_POPGC; rep_POPGC; rep_POPGC;
+	if (args == rep_NULL)
+	    return rep_NULL;
+	if (car != rep_CAR (form) || args != rep_CDR (form))
+	    form = Fcons (car, args);
+	return form;
+    }
+
+    if (!rep_SYMBOLP (car) || rep_KEYWORDP (car)
+	|| Fmemq (car, bound) != Qnil || rep_lexically_bound_p (car))
+	return analyse_list (form, bound);
+
+    value = Fsymbol_value (car, Qt);
+    if (rep_CELL8_TYPEP (value, rep_SF))
+    {
+	if (value == rep_VAL (&Squote))
+	    return form;
+	else if (value == rep_VAL (&Slambda))
+	    return analyse_lambda (form, bound);
+	else if (value == rep_VAL (&Scond))
+	{
+	    /* (cond CLAUSES...) */
+	    repv out = Qnil, ptr = rep_CDR (form), result = form;
+	    rep_bool changed = rep_FALSE;
+	    rep_GC_root gc_form, gc_bound, gc_out, gc_ptr;
+	    rep_PUSHGC (gc_form, form);
+	    rep_PUSHGC (gc_bound, bound);
+	    rep_PUSHGC (gc_out, out);
+	    rep_PUSHGC (gc_ptr, ptr);
+	    while (rep_CONSP (ptr))
+	    {
+		repv clause = analyse_list (rep_CAR (ptr), bound);
+		if (clause == rep_NULL)
+		{
+		    result = rep_NULL;
+		    break;
+		}
+		if (clause != rep_CAR (ptr))
+		    changed = rep_TRUE;
+		out = Fcons (clause, out);
+		ptr = rep_CDR (ptr);
+	    }
+	    if (result != rep_NULL && changed)
+		result = Fcons (rep_CAR (form), Fnreverse (out));
+	    rep_POPGC; rep_POPGC; rep_POPGC; rep_POPGC;
+	    return result;
+	}
+	else if (value == rep_VAL (&Sprogn) || value == rep_VAL (&Ssetq)
+		 || value == rep_VAL (&Sdefvar) || value == rep_VAL (&S_define))
+	{
+	    return analyse_list (form, bound);
+	}
+	else
+	    return form;
+    }
+    else if (rep_CONSP (value) && rep_CAR (value) == Qmacro)
+    {
+	repv fun = rep_CDR (value), expansion;
+	rep_GC_root gc_form, gc_bound;
+
+	if (rep_FUNARGP (fun) && rep_CONSP (rep_FUNARG (fun)->fun)
+	    && rep_CAR (rep_FUNARG (fun)->fun) == Qautoload)
+	{
+	    return form;
+	}
+
+	rep_PUSHGC (gc_form, form);
+	rep_PUSHGC (gc_bound, bound);
+	expansion = Fmacroexpand (form, Qnil);
+	rep_POPGC; rep_POPGC;
+
+	if (expansion == rep_NULL)
+	{
+	    if (rep_throw_value && rep_CAR (rep_throw_value) == Qerror)
+	    {
+		rep_throw_value = rep_NULL;
+		return form;
+	    }
+	    return rep_NULL;
+	}
+	if (expansion == form)
+	    return form;
+	form = expansion;
+	goto again;
+    }
+    else
+	return analyse_list (form, bound);
+}
+
+static struct lambda_info *
+find_lambda_info (repv lambda)
+{
+    struct lambda_info *li;
+    if (lambda_table_size == 0)
+	return 0;
+    lambda = rep_CDR (lambda);
+    li = lambda_table[LAMBDA_HASH (lambda, rep_structure)];
+    for (; li != 0; li = li->next)
+    {
+	if (li->lambda == lambda && li->structure == rep_structure)
+	    return li;
+    }
+    return 0;
+}
+
+/* Return the (ARGS . BODY) part of lambda expression LAMBDA, analysed
+   if possible, storing the descriptor of ARGS in *DESCP (or nil if it
+   has none), and the (ARGS . BODY) it was analysed from in *SOURCEP.
+   Returns rep_NULL if the analysis was interrupted by a non-local exit
+   other than an error. */
+static repv
+analysed_lambda (repv lambda, repv *descp, repv *sourcep)
+{
+    struct lambda_info *li;
+    repv result, desc;
+    rep_GC_root gc_lambda, gc_result;
+
+    *descp = Qnil;
+    *sourcep = rep_CDR (lambda);
+    if (rep_single_step_flag)
+	return rep_CDR (lambda);
+
+    li = find_lambda_info (lambda);
+    if (li != 0 && li->generation == rep_macro_generation)
+    {
+	*sourcep = rep_CDR (li->source);
+	if (li->desc != rep_NULL)
+	{
+	    *descp = li->desc;
+	    return li->analysed;
+	}
+	result = li->analysed;
+    }
+    else
+    {
+	/* don't let errors in unused code invoke the debugger */
+	repv source = li != 0 ? li->source : lambda;
+	repv bindings = rep_bind_symbol (Qnil, Qdebug_on_error, Qnil);
+	rep_GC_root gc_bindings, gc_source;
+	bindings = rep_bind_symbol (bindings, Qbacktrace_on_error, Qnil);
+	rep_PUSHGC (gc_bindings, bindings);
+	rep_PUSHGC (gc_source, source);
+	rep_PUSHGC (gc_lambda, lambda);
+	result = analyse_lambda (source, Qnil);
+	rep_POPGC; rep_POPGC; rep_POPGC;
+	rep_unbind_symbols (bindings);
+
+	if (result == rep_NULL)
+	    return rep_NULL;
+	if (result != lambda)
+	    enter_lambda_info (lambda, rep_CDR (result), source);
+	*sourcep = rep_CDR (source);
+	result = rep_CDR (result);
+    }
+
+    if (!rep_CONSP (result))
+	return result;
+
+    rep_PUSHGC (gc_lambda, lambda);
+    rep_PUSHGC (gc_result, result);
+    desc = parse_lambda_list (rep_CAR (result));
+    rep_POPGC; rep_POPGC;
+    if (desc == rep_NULL)
+	return rep_NULL;
+
+    li = find_lambda_info (lambda);
+    if (li != 0 && li->analysed == result)
+	li->desc = desc;
+    *descp = desc;
+    return result;
+}
+
+/* Called by the garbage collector after everything else has been
+   marked; forgets about analysed lambdas that are no longer
+   referenced, and marks the analysis of those that are. */
+void
+rep_mark_lambda_cache (void)
+{
+    rep_bool changed;
+    int i;
+
+    /* an analysed body may refer to other lambdas with entries */
+    do {
+	changed = rep_FALSE;
+	for (i = 0; i < lambda_table_size; i++)
+	{
+	    struct lambda_info *li;
+	    for (li = lambda_table[i]; li != 0; li = li->next)
+	    {
+		if (rep_GC_MARKEDP (li->lambda)
+		    && rep_GC_MARKEDP (li->structure))
+		{
+		    if (!rep_GC_MARKEDP (li->analysed))
+		    {
+			rep_MARKVAL (li->analysed);
+			changed = rep_TRUE;
+		    }
+		    if (li->desc != rep_NULL && !rep_GC_MARKEDP (li->desc))
+		    {
+			rep_MARKVAL (li->desc);
+			changed = rep_TRUE;
+		    }
+		    if (!rep_GC_MARKEDP (li->source))
+		    {
+			rep_MARKVAL (li->source);
+			changed = rep_TRUE;
+		    }
+		}
+	    }
+	}
+    } while (changed);
+
+    for (i = 0; i < lambda_table_size; i++)
+    {
+	struct lambda_info **ptr = &lambda_table[i];
+	while (*ptr != 0)
+	{
+	    struct lambda_info *li = *ptr;
+	    if (!rep_GC_MARKEDP (li->lambda)
+		|| !rep_GC_MARKEDP (li->structure))
+	    {
+		*ptr = li->next;
+		rep_free (li);
+		lambda_table_count--;
+	    }
+	    else
+		ptr = &li->next;
+	}
+    }
+}
+
+/* Like progn, evaluate the analysed forms BODY, but if the macro
+   generation moves on from GENERATION part way through, evaluate the
+   rest of the forms from SOURCE, the body they were analysed from,
+   instead. (Analysis replaces each top-level form by exactly one
+   form, so the two lists are the same length.) */
+static repv
+eval_analysed_body (repv body, repv source,
+		    unsigned long generation, repv tail_posn)
+{
+    repv result = Qnil;
+    repv old_current = rep_call_stack != 0 ? rep_call_stack->current_form : 0;
+    rep_GC_root gc_body, gc_source, gc_old_current;
+    rep_PUSHGC (gc_body, body);
+    rep_PUSHGC (gc_source, source);
+    rep_PUSHGC (gc_old_current, old_current);
+    while (rep_CONSP (body))
+    {
+	if (generation != rep_macro_generation && rep_CONSP (source))
+	    body = source;
+
+	if (rep_call_stack != 0)
+	    rep_call_stack->current_form = rep_CAR (body);
+
+	result = rep_eval (rep_CAR (body),
+			   rep_CDR (body) == Qnil ? tail_posn : Qnil);
+	body = rep_CDR (body);
+	source = rep_CONSP (source) ? rep_CDR (source) : Qnil;
+	rep_TEST_INT;
+	if (!result || rep_INTERRUPTP)
+	    break;
+    }
+    if (rep_call_stack != 0)
+	rep_call_stack->current_form = old_current;
+
+    rep_POPGC; rep_POPGC; rep_POPGC;
+    return result;
 }
 
 static repv
 eval_lambda(repv lambdaExp, repv argList, repv tail_posn)
 {
-    repv result;
+    repv result, desc, source;
+    unsigned long generation;
 again:
     result = rep_NULL;
-    lambdaExp = rep_CDR(lambdaExp);
+    {
+	rep_GC_root gc_argList;
+	rep_PUSHGC(gc_argList, argList);
+	lambdaExp = analysed_lambda(lambdaExp, &desc, &source);
+	rep_POPGC;
+	if(lambdaExp == rep_NULL)
+	    return rep_NULL;
+	generation = rep_macro_generation;
+    }
     if(rep_CONSP(lambdaExp))
     {
 	repv boundlist;
-	rep_GC_root gc_lambdaExp, gc_argList;
+	rep_GC_root gc_lambdaExp, gc_argList, gc_desc, gc_source;
 
+	rep_PUSHGC(gc_source, source);
 	rep_PUSHGC(gc_lambdaExp, lambdaExp);
 	rep_PUSHGC(gc_argList, argList);
-	boundlist = bind_lambda_list(rep_CAR(lambdaExp), argList);
-	rep_POPGC; rep_POPGC;
+	rep_PUSHGC(gc_desc, desc);
+	boundlist = bind_lambda_list(rep_CAR(lambdaExp), desc, argList);
+	rep_POPGC; rep_POPGC; rep_POPGC;
 
 	if(boundlist)
 	{
@@ -1422,8 +2190,11 @@ again:
 
 	    rep_GC_root gc_boundlist;
 	    rep_PUSHGC(gc_boundlist, boundlist);
-	    result = Fprogn(rep_CDR(lambdaExp), new_tail_posn);
-	    rep_POPGC;
+	    result = eval_analysed_body (rep_CDR(lambdaExp),
+					 rep_CONSP (source)
+					 ? rep_CDR (source) : Qnil,
+					 generation, new_tail_posn);
+	    rep_POPGC; rep_POPGC;
 	    rep_unbind_symbols(boundlist);
 
 	    if (tail_posn == Qnil
@@ -1448,7 +2219,10 @@ again:
 	    }
 	}
 	else
+	{
+	    rep_POPGC;
 	    result = rep_NULL;
+	}
     }
     return result;
 }
@@ -1458,7 +2232,9 @@ DEFSTRING(invl_autoload, "Can only autoload from symbols");
 /* Autoloads a value; FUNARG is a closure enclosing the autoload
    definition. The definition is a list `(autoload SYMBOL FILE ...)'
    This function tries to load FILE, then returns the value of SYMBOL
-   if successful, or rep_NULL for some kind of error.
+   if successful, or rep_NULL for some kind of error. Definitions made
+   by the compiled file loader instead refer to a single function body,
+   this is decoded into FUNARG, which is then returned.
 
    IMPORTANT: to ensure security, closure FUNARG must be active when
    this function is called. */
@@ -1473,6 +2249,9 @@ rep_load_autoload(repv funarg)
 		       rep_list_2(funarg, rep_VAL(&invl_autoload)));
     }
 
+    if (rep_lazy_function_p (rep_FUNARG(funarg)->fun))
+	return rep_load_lazy_function (funarg);
+
     aload_def = rep_FUNARG(funarg)->fun;
     if (rep_CONSP(aload_def))
 	aload_def = rep_CDR(aload_def);
@@ -1809,6 +2588,153 @@ ie,
     return rep_signal_missing_arg(1);
 }
 
+/* True if FUN is a primitive that eval_subr () can call */
+#define INLINE_SUBR_P(fun)						\
+    (rep_CELLP (fun) && rep_CELL8P (fun)				\
+     && ((rep_CELL8_TYPE (fun) >= rep_Subr0				\
+	  && rep_CELL8_TYPE (fun) <= rep_Subr5)				\
+	 || (rep_CELL8_TYPE (fun) == rep_SubrN && rep_SUBR_VEC_P (fun))))
+
+/* Call the primitive FUN with the values of the argument forms FORMS,
+   evaluating them straight into a vector instead of consing a list for
+   apply (). The call frame points to the vector, so the argument list
+   is only made if a backtrace asks for it. */
+static repv
+eval_subr (repv fun, repv forms)
+{
+    struct rep_Call lc;
+    rep_GC_root gc_fun, gc_forms;
+    rep_GC_n_roots gc_argv;
+    repv tem, result = rep_NULL, argv[5], *vec = argv;
+    int type = rep_CELL8_TYPE (fun), nargs, nforms, i;
+
+    for (nforms = 0, tem = forms; rep_CONSP (tem); tem = rep_CDR (tem))
+	nforms++;
+    if (tem != Qnil)
+    {
+	/* leave dotted argument lists to eval_list () */
+	rep_PUSHGC (gc_fun, fun);
+	tem = eval_list (forms);
+	rep_POPGC;
+	return tem ? apply (fun, tem, Qnil) : rep_NULL;
+    }
+
+    switch (type)
+    {
+    case rep_Subr0:
+	nargs = 0;
+	break;
+
+    case rep_Subr1:
+	nargs = 1;
+	argv[0] = Qnil;
+	break;
+
+    case rep_Subr2:
+	nargs = 2;
+	argv[0] = argv[1] = Qnil;
+	break;
+
+    case rep_Subr3:
+	nargs = 3;
+	argv[0] = argv[1] = argv[2] = Qnil;
+	break;
+
+    case rep_Subr4:
+	nargs = 4;
+	argv[0] = argv[1] = argv[2] = argv[3] = Qnil;
+	break;
+
+    case rep_Subr5:
+	nargs = 5;
+	argv[0] = argv[1] = argv[2] = argv[3] = argv[4] = Qnil;
+	break;
+
+    default:				/* vector subr */
+	type = rep_SubrV;
+	nargs = nforms;
+	if (nargs > 5)
+	    vec = alloca (nargs * sizeof (repv));
+    }
+
+    if (++rep_lisp_depth > rep_max_lisp_depth)
+    {
+	rep_lisp_depth--;
+	return Fsignal (Qerror, rep_LIST_1 (rep_VAL (&max_depth)));
+    }
+
+    rep_PUSHGC (gc_fun, fun);
+    rep_PUSHGC (gc_forms, forms);
+    rep_PUSHGCN (gc_argv, vec, type == rep_SubrV ? 0 : nargs);
+    for (i = 0; i < nforms; i++)
+    {
+	tem = rep_eval (rep_CAR (forms), Qnil);
+	if (tem == rep_NULL)
+	    goto out;
+	/* surplus arguments are evaluated, then ignored */
+	if (i < nargs)
+	{
+	    vec[i] = tem;
+	    if (type == rep_SubrV)
+		gc_argv.count = i + 1;
+	}
+	forms = rep_CDR (forms);
+	rep_TEST_INT;
+	if (rep_INTERRUPTP)
+	    goto out;
+    }
+
+    /* as apply () would */
+    rep_TEST_INT;
+    if (rep_INTERRUPTP)
+	goto out;
+
+    rep_MAY_YIELD;
+
+    lc.fun = fun;
+    lc.args = rep_void_value;
+    rep_PUSH_CALL (lc);
+    lc.argv = vec;
+    lc.argc = nforms < nargs ? nforms : nargs;
+
+    if (rep_data_after_gc >= rep_gc_threshold)
+	Fgarbage_collect (Qnil);
+
+    switch (type)
+    {
+    case rep_Subr0:
+	result = rep_SUBR0FUN (fun) ();
+	break;
+    case rep_Subr1:
+	result = rep_SUBR1FUN (fun) (vec[0]);
+	break;
+    case rep_Subr2:
+	result = rep_SUBR2FUN (fun) (vec[0], vec[1]);
+	break;
+    case rep_Subr3:
+	result = rep_SUBR3FUN (fun) (vec[0], vec[1], vec[2]);
+	break;
+    case rep_Subr4:
+	result = rep_SUBR4FUN (fun) (vec[0], vec[1], vec[2], vec[3]);
+	break;
+    case rep_Subr5:
+	result = rep_SUBR5FUN (fun) (vec[0], vec[1], vec[2], vec[3], vec[4]);
+	break;
+    default:
+	result = rep_SUBRVFUN (fun) (nargs, vec);
+    }
+
+    if (rep_throw_value != rep_NULL)
+	result = rep_NULL;
+
+    rep_POP_CALL (lc);
+
+out:
+    rep_POPGCN; rep_POPGC; rep_POPGC;
+    rep_lisp_depth--;
+    return result;
+}
+
 static repv
 eval(repv obj, repv tail_posn)
 {
@@ -1919,6 +2845,9 @@ eval(repv obj, repv tail_posn)
 	    {
 		rep_lisp_depth--;
 
+		if (INLINE_SUBR_P (funcobj))
+		    return eval_subr (funcobj, rep_CDR (obj));
+
 		rep_PUSHGC (gc_obj, funcobj);
 		ret = eval_list (rep_CDR (obj));
 		rep_POPGC;
@@ -2631,6 +3560,21 @@ stack_frame_ref (int idx)
     return 0;
 }
 
+/* Return the argument list of frame LC, making it from the frame's
+   argument vector if necessary (see eval_subr) */
+static repv
+frame_args (struct rep_Call *lc)
+{
+    if (rep_VOIDP (lc->args) && lc->argv != 0)
+    {
+	int i = lc->argc;
+	lc->args = Qnil;
+	while (i-- > 0)
+	    lc->args = Fcons (lc->argv[i], lc->args);
+    }
+    return lc->args;
+}
+
 DEFUN("backtrace", Fbacktrace, Sbacktrace, (repv strm), rep_Subr1) /*
 ::doc:rep.lang.debug#backtrace::
 backtrace [STREAM]
@@ -2688,7 +3632,7 @@ ARGLIST had been evaluated or not before being put into the stack.
 
 	    rep_princ_val (strm, function_name);
 
-	    if (rep_VOIDP (lc->args)
+	    if (rep_VOIDP (frame_args (lc))
 		|| (rep_STRINGP (function_name)
 		    && strcmp (rep_STR (function_name), "run-byte-code") == 0))
 		rep_stream_puts (strm, " ...", -1, rep_FALSE);
@@ -2737,7 +3681,7 @@ DEFUN ("stack-frame-ref", Fstack_frame_ref,
 
     if (lc != 0)
     {
-	return rep_list_5 (lc->fun, rep_VOIDP (lc->args)
+	return rep_list_5 (lc->fun, rep_VOIDP (frame_args (lc))
 			   ? rep_undefined_value : lc->args,
 			   lc->current_form ? lc->current_form : Qnil,
 			   lc->saved_env, lc->saved_structure);
@@ -1217,7 +1217,10 @@ like the last else in an else-if statement in C.
 static inline repv
 load_file_exists_p (repv name)
 {
-    repv tem = Ffile_readable_p (name);
+    repv tem;
+    if (!rep_file_may_exist (name))
+	return Qnil;
+    tem = Ffile_readable_p (name);
     if (tem && tem != Qnil)
     {
 	tem = Ffile_directory_p (name);
@@ -1237,7 +1240,7 @@ paths searched). The file is loaded in a null lexical environment,
 within STRUCTURE. The value of the last form evaluated is returned.
 ::end:: */
 {
-    repv stream, bindings = Qnil, result, tem;
+    repv stream, bindings = Qnil, result, tem, local;
     rep_GC_root gc_stream, gc_bindings;
     struct rep_Call lc;
     int c;
@@ -1250,9 +1253,15 @@ within STRUCTURE. The value of the last form evaluated is returned.
 
     rep_PUSHGC (gc_stream, name);
     rep_PUSHGC (gc_bindings, structure);
-    stream = Fopen_file (name, Qread);
+    local = Flocal_file_name (name);
+    if (local == rep_NULL)
+	stream = rep_NULL;
+    else if (rep_STRINGP (local) && rep_compiled_file_p (local))
+	stream = local;
+    else
+	stream = Fopen_file (name, Qread);
     rep_POPGC; rep_POPGC;
-    if (!stream || !rep_FILEP (stream))
+    if (!stream || !(rep_FILEP (stream) || rep_STRINGP (stream)))
 	return rep_NULL;
 
     bindings = rep_bind_symbol (bindings, Qload_filename, name);
@@ -1266,6 +1275,13 @@ within STRUCTURE. The value of the last form evaluated is returned.
     rep_env = Qnil;
     rep_structure = structure;
 
+    if (rep_STRINGP (stream))
+    {
+	/* Binary compiled file, STREAM is its local name */
+	result = rep_load_compiled_file (stream);
+	goto out;
+    }
+
     result = Qnil;
     c = rep_stream_getc (stream);
     while ((c != EOF) && (tem = rep_readl (stream, &c)))
@@ -1291,7 +1307,8 @@ out:
 
     rep_PUSHGC (gc_stream, result);
     rep_unbind_symbols (bindings);
-    Fclose_file (stream);
+    if (rep_FILEP (stream))
+	Fclose_file (stream);
     rep_POPGC;
 
     return result;
@@ -1333,8 +1350,9 @@ load FILE [NO-ERROR] [NO-PATH] [NO-SUFFIX]
 Attempt to open and then read-and-eval the file of Lisp code FILE.
 
 For each directory named in the variable `load-path' tries the value of
-FILE with `.jlc' (compiled-lisp) appended to it, then with `.jl' appended
-to it, finally tries FILE without modification.
+FILE with `.jlb' or `.jlc' (compiled-lisp, in binary or printed form)
+appended to it, then with `.jl' appended to it, finally tries FILE
+without modification. Of the two compiled forms, the newer is used.
 
 If NO-ERROR is non-nil no error is signalled if FILE can't be found. If
 NO-PATH is non-nil the `load-path' variable is not used, just the value
@@ -1415,6 +1433,25 @@ research:
 				    ? rep_CAR(suffixes) : rep_CDR(suffixes));
 			if (rep_STRINGP (sfx))
 			    try = rep_concat2(rep_STR(dir), rep_STR(sfx));
+			if (i == 1 && sfx == rep_CDR (default_suffixes)
+			    && try && rep_STRINGP (try))
+			{
+			    /* Prefer the binary form of the compiled
+			       file, unless the printed form is newer */
+			    repv binary = rep_concat2 (rep_STR(dir), ".jlb");
+			    rep_GC_root gc_binary;
+			    rep_PUSHGC (gc_binary, binary);
+			    tem = load_file_exists_p (binary);
+			    if (tem == Qt)
+			    {
+				tem = load_file_exists_p (try);
+				if (tem != Qt || !rep_file_newer_than (try, binary))
+				    try = binary;
+			    }
+			    rep_POPGC;
+			    if (!tem)
+				goto path_error;
+			}
 		    }
 
 		    if (try && rep_STRINGP (try))
@@ -94,7 +94,8 @@ inline_unbind (repv item)
 	int lexicals = rep_LEX_BINDINGS (item);
 	int specials = rep_SPEC_BINDINGS (item);
 	rep_env = list_tail (rep_env, lexicals);
-	rep_special_bindings = list_tail (rep_special_bindings, specials);
+	if (specials > 0)
+	    rep_unbind_specials (specials);
 	return specials;
     }
     else if (item == Qnil || (rep_CONSP (item) && rep_CAR (item) == Qerror))
@@ -130,15 +131,6 @@ snap_environment (int count)
     return ptr;
 }
 
-static repv
-search_special_bindings (repv sym)
-{
-    register repv env = rep_special_bindings;
-    while (env != Qnil && rep_CAAR(env) != sym)
-	env = rep_CDR(env);
-    return env != Qnil ? rep_CAR(env) : env;
-}
-
 /* Zero out N lisp pointers starting from address S */
 #define repv_bzero(s, n)		\
     do {				\
@@ -399,10 +391,10 @@ list_ref (repv list, int elt)
  &&TAG(OP_SET), &&TAG(OP_REQUIRED_ARG), &&TAG(OP_OPTIONAL_ARG), &&TAG(OP_REST_ARG), /*C8*/ \
  &&TAG(OP_NOT_ZERO_P), &&TAG(OP_KEYWORD_ARG), &&TAG(OP_OPTIONAL_ARG_), &&TAG(OP_KEYWORD_ARG_),	\
 										\
- &&TAG_DEFAULT, &&TAG_DEFAULT, &&TAG_DEFAULT, &&TAG_DEFAULT, /*D0*/	\
- &&TAG_DEFAULT, &&TAG_DEFAULT, &&TAG_DEFAULT, &&TAG_DEFAULT,		\
- &&TAG_DEFAULT, &&TAG_DEFAULT, &&TAG_DEFAULT, &&TAG_DEFAULT, /*D8*/	\
- &&TAG_DEFAULT, &&TAG_DEFAULT, &&TAG_DEFAULT, &&TAG_DEFAULT,		\
+ &&TAG(OP_ENCLOSE_FLAT), &&TAG(OP_FIX_ADD), &&TAG(OP_FIX_SUB), &&TAG(OP_FIX_INC), /*D0*/ \
+ &&TAG(OP_FIX_DEC), &&TAG(OP_FIX_LT), &&TAG(OP_FIX_GT), &&TAG(OP_FIX_LE),	\
+ &&TAG(OP_FIX_GE), &&TAG(OP_FIX_NUM_EQ), &&TAG(OP_CONS_CAR), &&TAG(OP_CONS_CDR), /*D8*/ \
+ &&TAG(OP_VECTOR_AREF), &&TAG_DEFAULT, &&TAG_DEFAULT, &&TAG_DEFAULT,		\
  &&TAG_DEFAULT, &&TAG_DEFAULT, &&TAG_DEFAULT, &&TAG_DEFAULT, /*E0*/	\
  &&TAG_DEFAULT, &&TAG_DEFAULT, &&TAG_DEFAULT, &&TAG_DEFAULT,		\
  &&TAG_DEFAULT, &&TAG_DEFAULT, &&TAG_DEFAULT, &&TAG_DEFAULT, /*E8*/	\
@@ -739,6 +731,14 @@ again: {
 		    break;
 
 		case rep_Compiled:
+		    /* Recursion needn't pass through a backwards jump, so
+		       check for interrupts here as well */
+		    rep_TEST_INT;
+		    if (rep_INTERRUPTP)
+		    {
+			TOP = rep_NULL;
+			break;
+		    }
 		    if (was_closed)
 		    {
 			repv (*bc_apply) (repv, int, repv *);
@@ -811,11 +811,19 @@ again: {
 				code = rep_COMPILED_CODE (tmp);
 				consts = rep_COMPILED_CONSTANTS (tmp);
 				gc_bindstack.first = bindstack;
+				gc_bindstack.count = 0;
 				gc_stack.first = stack + 1;
+				gc_stack.count = 0;
 				gc_slots.first = slots;
 				gc_slots.count = s_stkreq;
 				gc_argv.first = argv;
 				gc_argv.count = argc;
+
+				/* A loop of tail calls never jumps backwards,
+				   so check for gc and thread switches here */
+				if (rep_data_after_gc >= rep_gc_threshold)
+				    Fgarbage_collect (Qnil);
+				rep_MAY_YIELD;
 				goto again;
 			    }
 			}
@@ -1115,13 +1123,7 @@ again: {
 	END_INSN
 
 	BEGIN_INSN (OP_FLUID_REF)
-	    tmp = search_special_bindings (TOP);
-	    if (tmp != Qnil)
-	    {
-		TOP = rep_CDR (tmp);
-		SAFE_NEXT;
-	    }
-	    else if (rep_CONSP (TOP))
+	    if (rep_CONSP (TOP))
 	    {
 		TOP = rep_CDR (TOP);
 		SAFE_NEXT;
@@ -1135,6 +1137,23 @@ again: {
 	    INLINE_NEXT;
 	END_INSN
 
+	BEGIN_INSN (OP_ENCLOSE_FLAT)
+	    /* A closure whose environment is a fresh list of the N
+	       values below the function, instead of the whole of the
+	       current environment. The compiler only emits this when
+	       none of the captured variables are ever modified. */
+	    arg = FETCH;
+	    POP1 (tmp);
+	    for (tmp2 = Qnil; arg-- > 0;)
+	    {
+		repv x; POP1 (x);
+		tmp2 = inline_Fcons (x, tmp2);
+	    }
+	    PUSH (Fmake_closure (tmp, Qnil));
+	    rep_FUNARG (TOP)->env = tmp2;
+	    SAFE_NEXT;
+	END_INSN
+
 	BEGIN_INSN (OP_INIT_BIND)
 	    BIND_PUSH (rep_NEW_FRAME);
 	    SAFE_NEXT;
@@ -1872,6 +1891,9 @@ again: {
 	    {
 		/* a doable tail-call */
 		int nargs, i, n_req_v;
+		rep_TEST_INT;
+		if (rep_INTERRUPTP)
+		    HANDLE_ERROR;
 		rep_USE_FUNARG (tmp);
 		tmp = rep_FUNARG (tmp)->fun;
 		nargs = rep_list_length (args);
@@ -1986,8 +2008,7 @@ again: {
 
 	BEGIN_INSN (OP_FLUID_BIND)
 	    POP2 (tmp, tmp2);
-	    rep_special_bindings = Fcons (Fcons (tmp2, tmp),
-					  rep_special_bindings);
+	    rep_bind_fluid (tmp2, tmp);
 	    BIND_TOP = rep_MARK_SPEC_BINDING (BIND_TOP);
 	    impurity++;
 	    SAFE_NEXT;
@@ -2112,6 +2133,126 @@ again: {
 	    SAFE_NEXT;
 	END_INSN
 
+	/* Specialized instructions. The compiler only emits these when
+	   it knows the types of the operands, so they skip the checks
+	   made by the generic versions (except in safemach, where
+	   ASSERT is enabled). Fixnum arithmetic can still overflow. */
+
+	BEGIN_INSN (OP_FIX_ADD)
+	    POP1 (tmp);
+	    tmp2 = TOP;
+	    ASSERT (rep_INTP (tmp) && rep_INTP (tmp2));
+	    {
+		long x = rep_INT (tmp2) + rep_INT (tmp);
+		if (x >= rep_LISP_MIN_INT && x <= rep_LISP_MAX_INT)
+		{
+		    TOP = rep_MAKE_INT (x);
+		    SAFE_NEXT;
+		}
+	    }
+	    TOP = rep_number_add (tmp2, tmp);
+	    INLINE_NEXT;
+	END_INSN
+
+	BEGIN_INSN (OP_FIX_SUB)
+	    POP1 (tmp);
+	    tmp2 = TOP;
+	    ASSERT (rep_INTP (tmp) && rep_INTP (tmp2));
+	    {
+		long x = rep_INT (tmp2) - rep_INT (tmp);
+		if (x >= rep_LISP_MIN_INT && x <= rep_LISP_MAX_INT)
+		{
+		    TOP = rep_MAKE_INT (x);
+		    SAFE_NEXT;
+		}
+	    }
+	    TOP = rep_number_sub (tmp2, tmp);
+	    INLINE_NEXT;
+	END_INSN
+
+	BEGIN_INSN (OP_FIX_INC)
+	    ASSERT (rep_INTP (TOP));
+	    if (TOP != rep_MAKE_INT (rep_LISP_MAX_INT))
+	    {
+		TOP = rep_MAKE_INT (rep_INT (TOP) + 1);
+		SAFE_NEXT;
+	    }
+	    TOP = Fplus1 (TOP);
+	    NEXT;
+	END_INSN
+
+	BEGIN_INSN (OP_FIX_DEC)
+	    ASSERT (rep_INTP (TOP));
+	    if (TOP != rep_MAKE_INT (rep_LISP_MIN_INT))
+	    {
+		TOP = rep_MAKE_INT (rep_INT (TOP) - 1);
+		SAFE_NEXT;
+	    }
+	    TOP = Fsub1 (TOP);
+	    NEXT;
+	END_INSN
+
+	BEGIN_INSN (OP_FIX_LT)
+	    POP1 (tmp);
+	    ASSERT (rep_INTP (tmp) && rep_INTP (TOP));
+	    TOP = (rep_INT (TOP) < rep_INT (tmp)) ? Qt : Qnil;
+	    SAFE_NEXT;
+	END_INSN
+
+	BEGIN_INSN (OP_FIX_GT)
+	    POP1 (tmp);
+	    ASSERT (rep_INTP (tmp) && rep_INTP (TOP));
+	    TOP = (rep_INT (TOP) > rep_INT (tmp)) ? Qt : Qnil;
+	    SAFE_NEXT;
+	END_INSN
+
+	BEGIN_INSN (OP_FIX_LE)
+	    POP1 (tmp);
+	    ASSERT (rep_INTP (tmp) && rep_INTP (TOP));
+	    TOP = (rep_INT (TOP) <= rep_INT (tmp)) ? Qt : Qnil;
+	    SAFE_NEXT;
+	END_INSN
+
+	BEGIN_INSN (OP_FIX_GE)
+	    POP1 (tmp);
+	    ASSERT (rep_INTP (tmp) && rep_INTP (TOP));
+	    TOP = (rep_INT (TOP) >= rep_INT (tmp)) ? Qt : Qnil;
+	    SAFE_NEXT;
+	END_INSN
+
+	BEGIN_INSN (OP_FIX_NUM_EQ)
+	    POP1 (tmp);
+	    ASSERT (rep_INTP (tmp) && rep_INTP (TOP));
+	    TOP = (TOP == tmp) ? Qt : Qnil;
+	    SAFE_NEXT;
+	END_INSN
+
+	BEGIN_INSN (OP_CONS_CAR)
+	    ASSERT (rep_CONSP (TOP));
+	    TOP = rep_CAR (TOP);
+	    SAFE_NEXT;
+	END_INSN
+
+	BEGIN_INSN (OP_CONS_CDR)
+	    ASSERT (rep_CONSP (TOP));
+	    TOP = rep_CDR (TOP);
+	    SAFE_NEXT;
+	END_INSN
+
+	BEGIN_INSN (OP_VECTOR_AREF)
+	    /* the index still needs to be checked against the bounds */
+	    POP1 (tmp);
+	    tmp2 = TOP;
+	    ASSERT (rep_VECTORP (tmp2) && rep_INTP (tmp));
+	    if (rep_INT (tmp) >= 0 && rep_INT (tmp) < rep_VECT_LEN (tmp2))
+	    {
+		TOP = rep_VECTI (tmp2, rep_INT (tmp));
+		SAFE_NEXT;
+	    }
+	    TOP = Faref (tmp2, tmp);
+	    NEXT;
+	END_INSN
+
 	/* Jump instructions follow */
 
 	BEGIN_INSN (OP_EJMP)
@@ -2177,9 +2318,15 @@ again: {
 	END_INSN
 
 	BEGIN_INSN (OP_JMP)
-	do_jmp:
+	do_jmp: {
+	    unsigned char *from = pc;
 	    pc = (unsigned char *) rep_STR(code) + ((pc[0] << ARG_SHIFT) | pc[1]);
 
+	    /* Only backwards jumps can form a loop, so forward jumps
+	       needn't check for interrupts, gc or thread switches */
+	    if (pc > from)
+		SAFE_NEXT;
+
 	    /* Test if an interrupt occurred... */
 	    rep_TEST_INT;
 	    if(rep_INTERRUPTP)
@@ -2195,6 +2342,7 @@ again: {
 	    rep_MAY_YIELD;
 
 	    SAFE_NEXT;
+	}
 	END_INSN
 
 	BEGIN_DEFAULT_INSN
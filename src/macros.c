@@ -20,12 +20,17 @@
 
 /* Commentary:
 
-   The idea is to memoize macro expansions, but only until the next
-   garbage collection. This introduces very little memory overhead, two
-   cons cells per expansion (the expansion is around anyway until gc)
-
-   Whether it would be useful to keep expansions around for longer is
-   something that needs to be looked at later..
+   The idea is to memoize macro expansions. Each expansion is recorded
+   against the form that was expanded, the structure it was expanded
+   in, and the macro definition that did the expansion; if the head
+   of the form no longer names that definition when it's next looked
+   up the entry is ignored.
+
+   Entries survive garbage collection for as long as the expanded form
+   is itself alive (the expansion is marked on its behalf), so
+   interpreted code that is run repeatedly only needs expanding once.
+   The whole table is flushed when any macro binding is changed, since
+   the expansion may also have used other macros.
 
    It's actually pretty good on its own. E.g. doing (compile-compiler)
    with all interpreted code gives a miss ratio of about .023  */
@@ -38,14 +43,27 @@
 # include <memory.h>
 #endif
 
-#define HIST_SIZE 256
-#define HIST_HASH_FN(x) (((x) >> 4) % HIST_SIZE)
+struct expansion {
+    struct expansion *next;
+    repv form;
+    repv structure;
+    repv definition;
+    repv expansion;
+};
+
+static struct expansion **history;
+static int history_size, history_count;
+
+/* the table is flushed rather than growing any further than this */
+#define HIST_MAX_ENTRIES 32768
+
+#define HIST_HASH_FN(f,s) \
+    ((((f) >> 3) ^ ((s) >> 5)) & (history_size - 1))
 
-/* Each entry is a chain of cons cells. But note that the last cell's
-   cdr is dotted to ((repv)0) not Qnil */
-static repv history[HIST_SIZE];
+static unsigned long macro_hits, macro_misses;
 
-static int macro_hits, macro_misses;
+/* Incremented whenever a binding to or from a macro is changed */
+unsigned long rep_macro_generation;
 
 DEFSYM(macro_environment, "macro-environment");
 
@@ -133,6 +151,51 @@ again:
     return form;
 }
 
+/* Expand FORM until it isn't a macro call */
+static repv
+expand (repv form, repv env)
+{
+    repv pred = form;
+    rep_GC_root gc_pred;
+    rep_PUSHGC(gc_pred, pred);
+    while (1)
+    {
+	form = Fmacroexpand_1 (pred, env);
+	if (form == rep_NULL || form == pred)
+	    break;
+	pred = form;
+    }
+    rep_POPGC;
+    return form;
+}
+
+static void
+grow_history (void)
+{
+    int new_size = history_size ? history_size * 2 : 256, i;
+    struct expansion **new_history
+	= rep_alloc (sizeof (struct expansion *) * new_size);
+    if (new_history == 0)
+	return;
+    memset (new_history, 0, sizeof (struct expansion *) * new_size);
+    for (i = 0; i < history_size; i++)
+    {
+	struct expansion *e, *next;
+	for (e = history[i]; e != 0; e = next)
+	{
+	    unsigned int hash = ((((e->form) >> 3) ^ ((e->structure) >> 5))
+				 & (new_size - 1));
+	    next = e->next;
+	    e->next = new_history[hash];
+	    new_history[hash] = e;
+	}
+    }
+    if (history != 0)
+	rep_free (history);
+    history = new_history;
+    history_size = new_size;
+}
+
 DEFUN("macroexpand", Fmacroexpand, Smacroexpand,
       (repv form, repv env), rep_Subr2) /*
 ::doc:rep.lang.interpreter#macroexpand::
@@ -145,59 +208,161 @@ expansion. Any macro expanders recursively calling macroexpand should
 pass the value of the `macro-environment' variable to this parameter.
 ::end:: */
 {
-    repv input = form, pred, ptr;
-    rep_GC_root gc_input, gc_pred;
+    repv input = form, structure, definition;
+    struct expansion *e;
+    unsigned int hash;
+    rep_GC_root gc_input, gc_definition;
 
     if (!rep_CONSP (form))
 	return form;
 
+    /* Expansions by another expander function aren't remembered */
+    if (env != Qnil && !rep_STRUCTUREP (env))
+	return expand (form, env);
+
+    structure = rep_STRUCTUREP (env) ? env : rep_structure;
+    definition = rep_CAR (form);
+    if (rep_SYMBOLP (definition))
+	definition = symbol_value_in_structure (structure, definition);
+
     /* Search the history */
-    ptr = history[HIST_HASH_FN(form)];
-    while (ptr != 0)
+    if (history_size != 0)
     {
-	if (rep_CAAR (ptr) == form)
+	hash = HIST_HASH_FN (form, structure);
+	for (e = history[hash]; e != 0; e = e->next)
 	{
-	    macro_hits++;
-	    return rep_CDAR (ptr);
+	    if (e->form == form && e->structure == structure
+		&& e->definition == definition)
+	    {
+		macro_hits++;
+		return e->expansion;
+	    }
 	}
-	ptr = rep_CDR (ptr);
     }
     macro_misses++;
 
     rep_PUSHGC(gc_input, input);
-    rep_PUSHGC(gc_pred, pred);
-    pred = form;
-    while (1)
-    {
-	form = Fmacroexpand_1 (pred, env);
-	if (form == rep_NULL || form == pred)
-	    break;
-	pred = form;
-    }
+    rep_PUSHGC(gc_definition, definition);
+    form = expand (form, env);
     rep_POPGC; rep_POPGC;
 
-    if (form != rep_NULL)
+    if (form != rep_NULL && form != input)
     {
 	/* Cache for future use */
-	unsigned int hash = HIST_HASH_FN(input);
-	history[hash] = Fcons (Fcons (input, form), history[hash]);
+	if (history_count >= HIST_MAX_ENTRIES)
+	    rep_macros_clear_history ();
+	if (history_count >= history_size)
+	    grow_history ();
+	e = rep_alloc (sizeof (struct expansion));
+	if (e != 0 && history_size != 0)
+	{
+	    hash = HIST_HASH_FN (input, structure);
+	    e->form = input;
+	    e->structure = structure;
+	    e->definition = definition;
+	    e->expansion = form;
+	    e->next = history[hash];
+	    history[hash] = e;
+	    history_count++;
+	}
+	else if (e != 0)
+	    rep_free (e);
     }
 
     return form;
 }
 
+DEFUN("macroexpand-statistics", Fmacroexpand_statistics,
+      Smacroexpand_statistics, (void), rep_Subr0) /*
+::doc:rep.lang.interpreter#macroexpand-statistics::
+macroexpand-statistics
+
+Return a list `(HITS MISSES ENTRIES)' describing the table of
+remembered macro expansions: the number of times `macroexpand' found
+an expansion in the table, the number of times it had to expand the
+form, and the number of expansions currently remembered.
+::end:: */
+{
+    return rep_list_3 (rep_make_long_uint (macro_hits),
+		       rep_make_long_uint (macro_misses),
+		       rep_MAKE_INT (history_count));
+}
+
+/* Called by the garbage collector once everything else is marked.
+   Forgets expansions of forms that are no longer referenced, and
+   marks the expansions (and definitions) of those that still are */
 void
-rep_macros_before_gc (void)
+rep_macros_after_mark (void)
 {
-    /* XXX Perhaps be more discerning? (We would need to arrange some
-       XXX marking then though..) */
-    rep_macros_clear_history ();
+    rep_bool changed;
+    int i;
+
+    /* an expansion may contain other forms with entries */
+    do {
+	changed = rep_FALSE;
+	for (i = 0; i < history_size; i++)
+	{
+	    struct expansion *e;
+	    for (e = history[i]; e != 0; e = e->next)
+	    {
+		if (rep_GC_MARKEDP (e->form) && rep_GC_MARKEDP (e->structure))
+		{
+		    if ((rep_CELLP (e->expansion)
+			 && !rep_GC_MARKEDP (e->expansion))
+			|| (rep_CELLP (e->definition)
+			    && !rep_GC_MARKEDP (e->definition)))
+		    {
+			rep_MARKVAL (e->expansion);
+			rep_MARKVAL (e->definition);
+			changed = rep_TRUE;
+		    }
+		}
+	    }
+	}
+    } while (changed);
+
+    for (i = 0; i < history_size; i++)
+    {
+	struct expansion **ptr = &history[i];
+	while (*ptr != 0)
+	{
+	    struct expansion *e = *ptr;
+	    if (!rep_GC_MARKEDP (e->form) || !rep_GC_MARKEDP (e->structure))
+	    {
+		*ptr = e->next;
+		rep_free (e);
+		history_count--;
+	    }
+	    else
+		ptr = &e->next;
+	}
+    }
 }
 
 void
 rep_macros_clear_history (void)
 {
-    memset (history, 0, sizeof (history));
+    int i;
+    for (i = 0; i < history_size; i++)
+    {
+	struct expansion *e, *next;
+	for (e = history[i]; e != 0; e = next)
+	{
+	    next = e->next;
+	    rep_free (e);
+	}
+	history[i] = 0;
+    }
+    history_count = 0;
+}
+
+/* Called when a binding to or from a macro changes; any expansions
+   made so far may no longer be valid */
+void
+rep_macros_invalidate (void)
+{
+    rep_macro_generation++;
+    rep_macros_clear_history ();
 }
 
 void
@@ -206,8 +371,8 @@ rep_macros_init (void)
     repv tem = rep_push_structure ("rep.lang.interpreter");
     rep_ADD_SUBR(Smacroexpand);
     rep_ADD_SUBR(Smacroexpand_1);
+    rep_ADD_SUBR(Smacroexpand_statistics);
     rep_INTERN_SPECIAL(macro_environment);
     Fset (Qmacro_environment, Qnil);
-    rep_macros_clear_history ();
     rep_pop_structure (tem);
 }
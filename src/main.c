@@ -249,6 +249,7 @@ rep_init_from_dump(char *prog_name, int *argc, char ***argv,
 	rep_misc_init();
 	rep_streams_init();
 	rep_files_init();
+	rep_compiled_files_init ();
 	rep_datums_init();
 	rep_fluids_init();
 	rep_weak_refs_init ();
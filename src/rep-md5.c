@@ -92,11 +92,47 @@ the local filing system). The returned integer will have no more than
     return digest_to_repv (digest);
 }
 
+DEFUN ("md5-local-file-hex", Fmd5_local_file_hex,
+       Smd5_local_file_hex, (repv file), rep_Subr1) /*
+::doc:rep.util.md5#md5-local-file-hex::
+md5-local-file-hex LOCAL-FILE-NAME
+
+Return the MD5 message digest of the bytes stored in the file called
+LOCAL-FILE-NAME (which must name a file in the local filing system), as
+a string of 32 hexadecimal digits. Unlike `md5-local-file' this doesn't
+need rep to support bignums.
+::end:: */
+{
+    static const char hex_digits[16] = "0123456789abcdef";
+    FILE *fh;
+    unsigned char digest[16];
+    char hex_digest[32];
+    int i;
+
+    rep_DECLARE1 (file, rep_STRINGP);
+
+    fh = fopen (rep_STR (file), "r");
+    if (fh == 0)
+	return rep_signal_file_error (file);
+
+    md5_stream (fh, digest);
+    fclose (fh);
+
+    for (i = 0; i < 16; i++)
+    {
+	hex_digest[i*2] = hex_digits[digest[i] >> 4];
+	hex_digest[i*2+1] = hex_digits[digest[i] & 15];
+    }
+
+    return rep_string_dupn (hex_digest, 32);
+}
+
 repv
 rep_dl_init (void)
 {
     repv tem = rep_push_structure ("rep.util.md5");
     rep_ADD_SUBR(Smd5_string);
     rep_ADD_SUBR(Smd5_local_file);
+    rep_ADD_SUBR(Smd5_local_file_hex);
     return rep_pop_structure (tem);
 }
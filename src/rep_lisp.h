@@ -442,6 +442,14 @@ typedef struct {
 
 #define rep_SF_LITERAL	(1 << (rep_CELL8_TYPE_BITS + 8))
 
+/* Set once the symbol has been bound to a macro in any structure */
+#define rep_SF_MACRO	(1 << (rep_CELL8_TYPE_BITS + 9))
+
+/* The bits above the flags cache the hash of the symbol's name, or
+   zero if it hasn't been computed yet (see symbol-hash) */
+#define rep_SYMBOL_HASH_SHIFT	(rep_CELL8_TYPE_BITS + 10)
+#define rep_SYMBOL_HASH(v)	(rep_SYM(v)->car >> rep_SYMBOL_HASH_SHIFT)
+
 #define rep_SYM(v)		((rep_symbol *)rep_PTR(v))
 #define rep_SYMBOLP(v)		rep_CELL8_TYPEP(v, rep_Symbol)
 
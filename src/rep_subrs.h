@@ -441,6 +441,8 @@ extern repv rep_undefined_value;
 extern repv (*rep_deref_local_symbol_fun)(repv sym);
 extern repv (*rep_set_local_symbol_fun)(repv sym, repv val);
 extern void rep_intern_static(repv *, repv);
+extern unsigned long rep_hash_bytes (const void *ptr, size_t len);
+extern unsigned long rep_symbol_hash (repv sym);
 extern repv rep_call_with_closure (repv closure,
 				   repv (*fun)(repv arg), repv arg);
 extern repv rep_bind_symbol(repv, repv, repv);
@@ -563,6 +565,9 @@ extern repv Fprimitive_guardian_push (repv g, repv obj);
 extern repv Fprimitive_guardian_pop (repv g);
 extern void rep_mark_static(repv *);
 extern void rep_mark_value(repv);
+extern rep_bool rep_gc_live_p (repv val);
+extern void rep_register_ephemeron_hooks (rep_bool (*mark) (void),
+					  void (*prune) (void));
 extern repv Fcons(repv, repv);
 extern rep_GC_root *rep_gc_root_stack;
 extern rep_GC_n_roots *rep_gc_n_roots_stack;
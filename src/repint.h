@@ -131,6 +131,10 @@ struct rep_struct_struct {
     repv imports;
     repv accessible;
 
+    /* Bindings found in imported structures, see rep_search_imports */
+    struct rep_import_cache_entry *import_cache;
+    int import_cache_size;
+
     /* A list of the special variables that may be accessed in this
        environment, or Qt to denote all specials. */
     repv special_env;
@@ -154,6 +158,10 @@ extern int rep_structure_type;
 /* If set, bindings can be created by setq et al. */
 #define rep_STF_SET_BINDS	(1 << (rep_CELL16_TYPE_BITS + 2))
 
+/* If set, the body has been evaluated and compiled code instantiated
+   here may have its references to immutable bindings folded. */
+#define rep_STF_LINKED		(1 << (rep_CELL16_TYPE_BITS + 3))
+
 #define rep_SPECIAL_ENV   (rep_STRUCTURE(rep_structure)->special_env)
 
 #define rep_STRUCT_HASH(x,n) (((x) >> 3) % (n))
@@ -190,11 +198,17 @@ struct rep_Call {
     repv current_form;			/* used for debugging, set by progn */
     repv saved_env;
     repv saved_structure;
+
+    /* If ARGS is void and ARGV is non-null, the ARGC arguments are
+       still in this vector; the list is only made when asked for */
+    repv *argv;
+    int argc;
 };
 
 #define rep_PUSH_CALL(lc)		\
     do {				\
 	(lc).current_form = rep_NULL;	\
+	(lc).argv = 0;			\
 	(lc).saved_env = rep_env;	\
 	(lc).saved_structure = rep_structure; \
 	(lc).next = rep_call_stack;	\
@@ -21,6 +21,14 @@
 #ifndef REPINT_SUBRS_H
 #define REPINT_SUBRS_H
 
+/* from compiled-files.c */
+extern repv Fwrite_compiled_forms (repv file, repv forms, repv lazy);
+extern rep_bool rep_compiled_file_p (repv file);
+extern repv rep_load_compiled_file (repv file);
+extern rep_bool rep_lazy_function_p (repv fun);
+extern repv rep_load_lazy_function (repv funarg);
+extern void rep_compiled_files_init (void);
+
 /* from continuations.c */
 extern void rep_continuations_init (void);
 
@@ -40,6 +48,7 @@ extern void rep_find_init(void);
 extern void rep_find_kill(void);
 
 /* from fluids.c */
+extern void rep_bind_fluid (repv f, repv v);
 extern void rep_fluids_init (void);
 
 /* from lisp.c */
@@ -53,9 +62,11 @@ extern repv rep_copy_list(repv);
 extern rep_bool rep_compare_error(repv error, repv handler);
 extern void rep_lisp_init(void);
 extern rep_bool rep_single_step_flag;
+extern rep_xsubr Sprogn;
+extern void rep_mark_lambda_cache (void);
 
 /* from lispcmds.c */
-extern rep_xsubr Slambda;
+extern rep_xsubr Squote, Slambda, Scond;
 extern repv Qload_filename;
 extern repv Fcall_with_exception_handler (repv, repv);
 extern void rep_lispcmds_init(void);
@@ -83,8 +94,11 @@ extern char *rep_stack_bottom;
 extern void rep_deprecated (rep_bool *seen, const char *desc);
 
 /* from macros.c */
-extern void rep_macros_before_gc (void);
+extern unsigned long rep_macro_generation;
+extern repv Fmacroexpand_statistics (void);
+extern void rep_macros_after_mark (void);
 extern void rep_macros_clear_history (void);
+extern void rep_macros_invalidate (void);
 extern void rep_macros_init (void);
 
 /* from misc.c */
@@ -131,6 +145,8 @@ extern repv Qfeatures, Q_structures, Q_meta, Qrep, Q_specials,
     Q_user_structure, Qrep_structures, Qrep_lang_interpreter,
     Qrep_vm_interpreter, Qexternal, Qinternal;
 extern rep_struct_node *rep_search_imports (rep_struct *s, repv var);
+extern void rep_link_closure (repv funarg);
+extern repv *rep_special_value_cell (repv var);
 extern repv Fmake_structure (repv, repv, repv, repv);
 extern repv F_structure_ref (repv, repv);
 extern repv Fstructure_set (repv, repv, repv);
@@ -147,11 +163,16 @@ extern void rep_structures_init (void);
 
 /* from symbols.c */
 extern repv rep_keyword_obarray;
+extern rep_xsubr Sdefvar, Ssetq, S_define;
+extern rep_bool rep_lexically_bound_p (repv sym);
 extern int rep_pre_symbols_init(void);
 extern void rep_symbols_init(void);
 extern int rep_allocated_funargs, rep_used_funargs;
 extern repv Freal_set (repv var, repv value);
 extern repv rep_bind_special (repv oldList, repv symbol, repv newVal);
+extern void rep_unbind_specials (int count);
+extern void rep_unwind_special_bindings (repv to);
+extern void rep_reroot_special_bindings (repv target);
 
 /* from tuples.c */
 extern int rep_allocated_tuples, rep_used_tuples;
@@ -217,6 +238,8 @@ extern repv rep_set_file_modes(repv file, repv modes);
 extern repv rep_file_modes_as_string(repv file);
 extern repv rep_file_modtime(repv file);
 extern repv rep_directory_files(repv dir_name);
+extern unsigned long rep_files_changed;
+extern rep_bool rep_file_may_exist (repv file);
 extern repv rep_read_symlink (repv file);
 extern repv rep_make_symlink (repv file, repv contents);
 extern repv rep_getpwd(void);
@@ -18,12 +18,9 @@
    along with librep; see the file COPYING.  If not, write to
    the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.  */
 
-/* Uncomment the next line to print cache miss ratios */
+/* Uncomment the next line to define structure-stats */
 /* #define DEBUG 1 */
 
-/* The cache type */
-#define SINGLE_SA_CACHE 1
-
 /* Notes:
 
    rep's module system is based on the Scheme48 system, which itself
@@ -107,6 +104,7 @@ char *alloca ();
 #endif
 
 #include "repint.h"
+#include "bytecodes.h"
 #include <string.h>
 #include <assert.h>
 #ifdef NEED_MEMORY_H
@@ -121,6 +119,9 @@ static rep_struct *all_structures;
 
 #define rep_INTERFACEP(v) rep_LISTP(v)
 
+/* changing bindings like this invalidates analysed lambdas */
+#define MACRO_BINDING_P(v) (rep_CONSP(v) && rep_CAR(v) == Qmacro)
+
 /* the currently active namespace */
 repv rep_structure;
 
@@ -150,247 +151,169 @@ static rep_struct_node *lookup_or_add (rep_struct *s, repv var);
 
 /* cached lookups */
 
-#ifdef DEBUG
-/* Hits and misses are obvious. Collisions occur when a miss ejects data
-   from the cache, conflicts when a miss ejects data for the _same_ symbol. */
-static int ref_cache_hits, ref_cache_misses,
-    ref_cache_collisions, ref_cache_conflicts;
+/* Bindings found by rep_search_imports are remembered in a small
+   direct-mapped table belonging to the importing structure, which
+   doubles in size when an entry displaces a live one.
 
-static void
-print_cache_stats (void)
-{
-    fprintf (stderr, "ref cache miss ratio: %g\n",
-	     (double) ref_cache_misses / (ref_cache_hits + ref_cache_misses));
-    fprintf (stderr, "        - collisions: %g\n",
-	     (double) ref_cache_collisions / ref_cache_misses);
-    fprintf (stderr, "        -  conflicts: %g\n",
-	     (double) ref_cache_conflicts / ref_cache_misses);
-}
-#endif
+   Each entry records the value of cache_clock when it was made, and
+   is only used if that's later than both cache_flushed and the stamp
+   of its symbol in symbol_stamps. So all entries can be invalidated
+   by advancing cache_flushed, and all entries for one symbol by
+   updating its stamp, without touching any of the tables. */
 
-#if defined SINGLE_DM_CACHE
+struct rep_import_cache_entry {
+    repv symbol;
+    rep_struct_node *n;
+    unsigned int stamp;
+};
 
-/* This is a very simple cache; a single direct-mapped table, indexed by
-   symbol address */
+#define IMPORT_CACHE_MIN 16
+#define IMPORT_CACHE_MAX 1024
+#define IMPORT_CACHE_HASH(x, size) (((x) >> 3) & ((size) - 1))
 
-#define CACHE_SETS 256
-#define CACHE_HASH(x) (((x) >> 4) % CACHE_SETS)
+#define SYMBOL_STAMPS 512
+#define SYMBOL_STAMP(x) symbol_stamps[((x) >> 3) % SYMBOL_STAMPS]
 
-struct cache_line {
-    rep_struct *s;
-    rep_struct_node *n;
-};
+static unsigned int cache_clock = 1, cache_flushed;
+static unsigned int symbol_stamps[SYMBOL_STAMPS];
 
-static struct cache_line ref_cache[CACHE_SETS];
+static unsigned long cache_hits, cache_misses, cache_evictions;
+static unsigned long cache_flushes, cache_symbol_flushes;
 
-static inline void
-enter_cache (rep_struct *s, rep_struct_node *binding)
-{
-    unsigned int hash = CACHE_HASH (binding->symbol);
-    if (ref_cache[hash].s != 0)
-    {
-#ifdef DEBUG
-	if (ref_cache[hash].n->symbol == binding->symbol)
-	    ref_cache_conflicts++;
-	else
-	    ref_cache_collisions++;
-#endif
-    }
-    ref_cache[hash].s = s;
-    ref_cache[hash].n = binding;
-}
+#define CACHE_ENTRY_VALID_P(e) \
+    ((e)->stamp > cache_flushed && (e)->stamp > SYMBOL_STAMP ((e)->symbol))
 
-static inline rep_struct_node *
-lookup_cache (rep_struct *s, repv var)
+/* Return the next value of the clock. When it would wrap around, all
+   tables are emptied and the clock starts again */
+static unsigned int
+tick_cache_clock (void)
 {
-    unsigned int hash = CACHE_HASH (var);
-    if (ref_cache[hash].s == s && ref_cache[hash].n->symbol == var)
-    {
-#ifdef DEBUG
-	ref_cache_hits++;
-#endif
-	return ref_cache[hash].n;
-    }
-    else
+    if (cache_clock == UINT_MAX)
     {
-#ifdef DEBUG
-	ref_cache_misses++;
-#endif
-	return 0;
+	rep_struct *s;
+	for (s = all_structures; s != 0; s = s->next)
+	{
+	    if (s->import_cache != 0)
+	    {
+		rep_free (s->import_cache);
+		s->import_cache = 0;
+		s->import_cache_size = 0;
+	    }
+	}
+	memset (symbol_stamps, 0, sizeof (symbol_stamps));
+	cache_flushed = 0;
+	cache_clock = 1;
     }
-}
-
-static inline void
-cache_invalidate_symbol (repv symbol)
-{
-    unsigned int hash = CACHE_HASH (symbol);
-    if (ref_cache[hash].s != 0 && ref_cache[hash].n->symbol == symbol)
-	ref_cache[hash].s = 0;
+    return cache_clock++;
 }
 
 static void
-cache_invalidate_struct (rep_struct *s)
+grow_cache (rep_struct *s)
 {
-    int i;
-    for (i = 0; i < CACHE_SETS; i++)
+    struct rep_import_cache_entry *old = s->import_cache;
+    int i, old_size = s->import_cache_size;
+    int new_size = old_size == 0 ? IMPORT_CACHE_MIN : old_size * 2;
+
+    s->import_cache = rep_alloc (new_size * sizeof (*old));
+    memset (s->import_cache, 0, new_size * sizeof (*old));
+    s->import_cache_size = new_size;
+    for (i = 0; i < old_size; i++)
     {
-	if (ref_cache[i].s == s)
-	    ref_cache[i].s = 0;
+	if (old[i].n != 0 && CACHE_ENTRY_VALID_P (&old[i]))
+	    s->import_cache[IMPORT_CACHE_HASH (old[i].symbol, new_size)] = old[i];
     }
+    if (old != 0)
+	rep_free (old);
 }
 
-static inline void
-cache_flush (void)
-{
-    /* assumes null pointer == all zeros.. */
-    memset (ref_cache, 0, sizeof (ref_cache));
-}
-
-#elif defined SINGLE_SA_CACHE 
-
-/* The above doesn't work so well now that there are more modules,
-   moving to 4-way set-associative eliminates significant conflict
-   misses in most cases. */
-
-#define CACHE_SETS 128
-#define CACHE_HASH(x) (((x) >> 3) % CACHE_SETS)
-#define CACHE_ASSOC 4
-
-struct cache_line {
-    rep_struct *s;
-    rep_struct_node *n;
-    int age;
-};
-
-static struct cache_line ref_cache[CACHE_SETS][CACHE_ASSOC];
-static int ref_age;
-
 static inline void
 enter_cache (rep_struct *s, rep_struct_node *binding)
 {
-    unsigned int hash = CACHE_HASH (binding->symbol);
-    int i, oldest_i, oldest_age = INT_MAX;
-    for (i = 0; i < CACHE_ASSOC; i++)
+    struct rep_import_cache_entry *e;
+    repv var = binding->symbol;
+
+    if (s->import_cache_size == 0)
+	grow_cache (s);
+    e = &s->import_cache[IMPORT_CACHE_HASH (var, s->import_cache_size)];
+    if (e->n != 0 && e->symbol != var && CACHE_ENTRY_VALID_P (e))
     {
-	if (ref_cache[hash][i].s == 0)
-	{
-	    oldest_i = i;
-	    break;
-	}
-	else if (ref_cache[hash][i].age < oldest_age)
+	cache_evictions++;
+	if (s->import_cache_size < IMPORT_CACHE_MAX)
 	{
-	    oldest_i = i;
-	    oldest_age = ref_cache[hash][i].age;
+	    grow_cache (s);
+	    e = &s->import_cache[IMPORT_CACHE_HASH (var, s->import_cache_size)];
 	}
     }
-    assert (oldest_i < CACHE_ASSOC);
-#ifdef DEBUG
-    if (ref_cache[hash][oldest_i].s != 0)
-    {
-	if (ref_cache[hash][oldest_i].n->symbol == binding->symbol)
-	    ref_cache_conflicts++;
-	else
-	    ref_cache_collisions++;
-    }
-#endif
-    ref_cache[hash][oldest_i].s = s;
-    ref_cache[hash][oldest_i].n = binding;
-    ref_cache[hash][oldest_i].age = ++ref_age;
+    e->symbol = var;
+    e->n = binding;
+    e->stamp = cache_clock;
 }
 
 static inline rep_struct_node *
 lookup_cache (rep_struct *s, repv var)
 {
-    unsigned int hash = CACHE_HASH (var);
-    int i;
-    for (i = 0; i < CACHE_ASSOC; i++)
+    if (s->import_cache_size != 0)
     {
-	if (ref_cache[hash][i].s == s && ref_cache[hash][i].n->symbol == var)
+	struct rep_import_cache_entry *e
+	    = &s->import_cache[IMPORT_CACHE_HASH (var, s->import_cache_size)];
+	if (e->symbol == var && e->n != 0 && CACHE_ENTRY_VALID_P (e))
 	{
-#ifdef DEBUG
-	    ref_cache_hits++;
-#endif
-	    ref_cache[hash][i].age++;
-	    return ref_cache[hash][i].n;
+	    cache_hits++;
+	    return e->n;
 	}
     }
-#ifdef DEBUG
-    ref_cache_misses++;
-#endif
+    cache_misses++;
     return 0;
 }
 
+/* Forget any cached bindings of SYMBOL. If it has ever named a macro,
+   the binding it resolves to may have been expanded somewhere */
 static inline void
 cache_invalidate_symbol (repv symbol)
 {
-    unsigned int hash = CACHE_HASH (symbol);
-    int i;
-    for (i = 0; i < CACHE_ASSOC; i++)
-    {
-	if (ref_cache[hash][i].s != 0
-	    && ref_cache[hash][i].n->symbol == symbol)
-	{
-	    ref_cache[hash][i].s = 0;
-	}
-    }
-}
-
-static void
-cache_invalidate_struct (rep_struct *s)
-{
-    int i, j;
-    for (i = 0; i < CACHE_SETS; i++)
-    {
-	for (j = 0; j < CACHE_ASSOC; j++)
-	{
-	    if (ref_cache[i][j].s == s)
-		ref_cache[i][j].s = 0;
-	}
-    }
+    SYMBOL_STAMP (symbol) = tick_cache_clock ();
+    cache_symbol_flushes++;
+    if (rep_SYM (symbol)->car & rep_SF_MACRO)
+	rep_macros_invalidate ();
 }
 
+/* Forget all cached bindings */
 static inline void
 cache_flush (void)
 {
-    /* assumes null pointer == all zeros.. */
-    memset (ref_cache, 0, sizeof (ref_cache));
-}
-
-#else /* SINGLE_SA_CACHE */
-
-/* no cache at all */
-
-static inline void
-enter_cache (rep_struct *s, rep_struct_node *binding)
-{
-}
-
-static inline rep_struct_node *
-lookup_cache (rep_struct *s, repv var)
-{
-#ifdef DEBUG
-    ref_cache_misses++;
-#endif
-    return 0;
+    cache_flushed = tick_cache_clock ();
+    cache_flushes++;
 }
 
+/* Called when the names visible from a structure may resolve to
+   different bindings, so any macro expansions made using them too */
 static inline void
-cache_invalidate_symbol (repv symbol)
+imports_changed (void)
 {
+    cache_flush ();
+    rep_macros_invalidate ();
 }
 
-static void
-cache_invalidate_struct (rep_struct *s)
-{
-}
+DEFUN("structure-cache-statistics", Fstructure_cache_statistics,
+      Sstructure_cache_statistics, (void), rep_Subr0) /*
+::doc:rep.structures#structure-cache-statistics::
+structure-cache-statistics
 
-static void
-cache_flush (void)
+Return a list `(HITS MISSES EVICTIONS FLUSHES SYMBOL-FLUSHES)'
+describing the caches of bindings imported by structures: the number
+of lookups that found a cached binding, the number that had to search
+the imported structures, the number of cached bindings displaced by
+others, the number of times every cached binding was discarded, and
+the number of times the cached bindings of a single symbol were.
+::end:: */
 {
+    return rep_list_5 (rep_make_long_uint (cache_hits),
+		       rep_make_long_uint (cache_misses),
+		       rep_make_long_uint (cache_evictions),
+		       rep_make_long_uint (cache_flushes),
+		       rep_make_long_uint (cache_symbol_flushes));
 }
 
-#endif /* !SINGLE_DM_CACHE */
-
 
 /* type hooks */
 
@@ -418,7 +341,8 @@ static void
 free_structure (rep_struct *x)
 {
     int i;
-    cache_invalidate_struct (x);
+    /* other structures may have cached its bindings */
+    cache_flush ();
     for (i = 0; i < x->total_buckets; i++)
     {
 	rep_struct_node *n, *next;
@@ -430,6 +354,8 @@ free_structure (rep_struct *x)
     }
     if (x->total_buckets > 0)
 	rep_free (x->buckets);
+    if (x->import_cache != 0)
+	rep_free (x->import_cache);
     rep_FREE_CELL (x);
 }
 
@@ -551,6 +477,7 @@ lookup_or_add (rep_struct *s, repv var)
 	n = rep_alloc (sizeof (rep_struct_node));
 	rep_data_after_gc += sizeof (rep_struct_node);
 	n->symbol = var;
+	n->binding = rep_void_value;
 	n->is_constant = 0;
 	n->is_exported = (s->car & rep_STF_EXPORT_ALL) != 0;
 	n->next = s->buckets[rep_STRUCT_HASH (var, s->total_buckets)];
@@ -636,6 +563,22 @@ rep_search_imports (rep_struct *s, repv var)
     }
 }
 
+/* Return a pointer to the value cell of special variable VAR, creating
+   a void binding in the specials structure if there isn't one. Used by
+   the shallow binding code in symbols.c */
+repv *
+rep_special_value_cell (repv var)
+{
+    rep_struct *s = rep_STRUCTURE (rep_specials_structure);
+    rep_struct_node *n = lookup (s, var);
+    if (n == 0)
+    {
+	n = lookup_or_add (s, var);
+	n->binding = rep_void_value;
+    }
+    return &n->binding;
+}
+
 
 /* lisp functions */
 
@@ -678,10 +621,157 @@ Assign the name NAME (a symbol) to structure object STRUCTURE.
 	Fstructure_define (rep_structures_structure,
 			   rep_STRUCTURE (structure)->name, Qnil);
     }
-    cache_flush ();
+    imports_changed ();
     return name;
 }
 
+/* Load-time linking of compiled code
+
+   Once a structure's body has been evaluated its own bindings are
+   known and its imports are fixed, so any global reference (OP_REFG)
+   from its compiled functions that resolves to an immutable binding
+   will always produce the same value. Rewrite each such reference into
+   an OP_PUSH of that value, storing it in the constant vector slot that
+   used to hold the symbol.
+
+   A slot is only rewritten when every instruction using it is an
+   OP_REFG, since the compiler shares constants between instructions
+   (e.g. a quoted symbol and a reference to its binding). OP_PUSH uses
+   the same argument encoding as OP_REFG, so only the opcode byte
+   changes. */
+
+/* Return the length of the instruction at PC, setting *ARGP to its
+   constant vector index if it has one, or -1 if not */
+static int
+insn_length (unsigned char *pc, int *argp)
+{
+    int op = pc[0];
+    *argp = -1;
+    if (op <= OP_LAST_WITH_ARGS)
+    {
+	int len = 1, arg = op & OP_ARG_MASK;
+	if (arg == OP_ARG_1BYTE)
+	    arg = pc[1], len = 2;
+	else if (arg == OP_ARG_2BYTE)
+	    arg = (pc[1] << ARG_SHIFT) | pc[2], len = 3;
+	switch (op & OP_OP_MASK)
+	{
+	case OP_PUSH: case OP_REFG: case OP_SETG:
+	    *argp = arg;
+	}
+	return len;
+    }
+    else if (op == OP_PUSHI || op == OP_ENCLOSE_FLAT)
+	return 2;
+    else if (op == OP_PUSHIWN || op == OP_PUSHIWP
+	     || op > OP_LAST_BEFORE_JMPS)
+	return 3;
+    else
+	return 1;
+}
+
+static void
+link_compiled (rep_struct *s, repv code, repv consts)
+{
+    unsigned char *start, *end, *pc;
+    signed char *only_refg;
+    int i, n_consts, arg, len;
+
+    if (!rep_STRINGP (code) || !rep_STRING_WRITABLE_P (code)
+	|| !rep_VECTORP (consts) || !rep_VECTOR_WRITABLE_P (consts))
+	return;
+
+    /* inner functions will be instantiated in the same structure */
+    n_consts = rep_VECT_LEN (consts);
+    for (i = 0; i < n_consts; i++)
+    {
+	repv c = rep_VECTI (consts, i);
+	if (rep_COMPILEDP (c))
+	    link_compiled (s, rep_COMPILED_CODE (c), rep_COMPILED_CONSTANTS (c));
+    }
+
+    if (n_consts <= 0)
+	return;
+    only_refg = alloca (n_consts);
+    memset (only_refg, 0, n_consts);
+    start = (unsigned char *) rep_STR (code);
+    end = start + rep_STRING_LEN (code);
+    for (pc = start; pc < end; pc += len)
+    {
+	len = insn_length (pc, &arg);
+	if (arg >= 0 && arg < n_consts)
+	{
+	    if ((pc[0] & OP_OP_MASK) == OP_REFG && only_refg[arg] >= 0)
+		only_refg[arg] = 1;
+	    else
+		only_refg[arg] = -1;
+	}
+    }
+
+    for (i = 0; i < n_consts; i++)
+    {
+	repv var = rep_VECTI (consts, i);
+	rep_struct_node *n;
+	if (only_refg[i] <= 0 || !rep_SYMBOLP (var))
+	    continue;
+	n = lookup (s, var);
+	if (n == 0)
+	    n = rep_search_imports (s, var);
+	/* compiled objects are left alone, they would be
+	   mistaken for inner functions if linked again */
+	if (n == 0 || !n->is_constant
+	    || rep_VOIDP (n->binding) || rep_COMPILEDP (n->binding))
+	    only_refg[i] = 0;
+	else
+	    rep_VECTI (consts, i) = n->binding;
+    }
+
+    for (pc = start; pc < end; pc += len)
+    {
+	len = insn_length (pc, &arg);
+	if (arg >= 0 && arg < n_consts && only_refg[arg] > 0)
+	    pc[0] = OP_PUSH + (pc[0] & OP_ARG_MASK);
+    }
+}
+
+/* If FUNARG is a compiled closure of a structure whose body has been
+   evaluated, fold its references to immutable bindings. Called for each
+   function bound in the structure once it's been loaded, and for lazily
+   loaded functions as they are read. */
+void
+rep_link_closure (repv funarg)
+{
+    repv s = rep_FUNARG (funarg)->structure;
+    repv fun = rep_FUNARG (funarg)->fun;
+    if (rep_STRUCTUREP (s) && rep_COMPILEDP (fun)
+	&& (rep_STRUCTURE (s)->car & rep_STF_LINKED)
+	/* bindings may be created at any time by setq */
+	&& !(rep_STRUCTURE (s)->car & rep_STF_SET_BINDS))
+    {
+	link_compiled (rep_STRUCTURE (s), rep_COMPILED_CODE (fun),
+		       rep_COMPILED_CONSTANTS (fun));
+    }
+}
+
+static void
+link_structure (rep_struct *s)
+{
+    int i;
+    s->car |= rep_STF_LINKED;
+    for (i = 0; i < s->total_buckets; i++)
+    {
+	rep_struct_node *n;
+	for (n = s->buckets[i]; n != 0; n = n->next)
+	{
+	    repv fun = n->binding;
+	    if (MACRO_BINDING_P (fun))
+		fun = rep_CDR (fun);
+	    if (rep_FUNARGP (fun) && rep_FUNARG (fun)->structure == rep_VAL (s))
+		rep_link_closure (fun);
+	}
+    }
+}
+
 /* environment of thunks are modified! */
 DEFUN ("make-structure", Fmake_structure, Smake_structure,
        (repv sig, repv header_thunk, repv body_thunk, repv name), rep_Subr4) /*
@@ -727,6 +817,8 @@ BODY-THUNK may be modified by this function!
     s->inherited = sig;
     s->name = name;
     s->total_buckets = s->total_bindings = 0;
+    s->import_cache = 0;
+    s->import_cache_size = 0;
     s->imports = Qnil;
     s->accessible = Qnil;
     s->special_env = Qt;
@@ -763,6 +855,8 @@ BODY-THUNK may be modified by this function!
 	tem = rep_call_lisp0 (body_thunk);
 	if (tem == rep_NULL)
 	    s = 0;
+	else
+	    link_structure (s);
     }
     rep_POPGC;
 
@@ -845,6 +939,11 @@ STRUCTURE to VALUE. If no such binding exists, an error is signalled.
 	{
 	    if (!n->is_constant)
 	    {
+		if (MACRO_BINDING_P (value) || MACRO_BINDING_P (n->binding))
+		{
+		    rep_SYM (var)->car |= rep_SF_MACRO;
+		    rep_macros_invalidate ();
+		}
 		n->binding = value;
 		return value;
 	    }
@@ -856,6 +955,11 @@ STRUCTURE to VALUE. If no such binding exists, an error is signalled.
     }
     else
     {
+	/* folded references would still see the old value */
+	n = lookup (s, var);
+	if (n != 0 && n->is_constant)
+	    return Fsignal (Qsetting_constant, rep_LIST_1 (var));
+	rep_macros_invalidate ();
 	remove_binding (s, var);
 	return Qnil;
     }
@@ -883,6 +987,11 @@ STRUCTURE to VALUE. If no such binding exists, one is created.
 	n = lookup_or_add (s, var);
 	if (!n->is_constant)
 	{
+	    if (MACRO_BINDING_P (value) || MACRO_BINDING_P (n->binding))
+	    {
+		rep_SYM (var)->car |= rep_SF_MACRO;
+		rep_macros_invalidate ();
+	    }
 	    n->binding = value;
 	    return value;
 	}
@@ -891,6 +1000,11 @@ STRUCTURE to VALUE. If no such binding exists, one is created.
     }
     else
     {
+	/* folded references would still see the old value */
+	n = lookup (s, var);
+	if (n != 0 && n->is_constant)
+	    return Fsignal (Qsetting_constant, rep_LIST_1 (var));
+	rep_macros_invalidate ();
 	remove_binding (s, var);
 	return Qnil;
     }
@@ -1045,7 +1159,7 @@ Set the interface of structure object STRUCTURE to INTERFACE.
 	}
     }
 
-    cache_flush ();
+    imports_changed ();
     return Qt;
 }
 
@@ -1143,7 +1257,7 @@ named in the list STRUCT-NAMES.
 	args = rep_CDR (args);
     }
     rep_POPGC;
-    cache_flush ();
+    imports_changed ();
     return ret;
 }
 
@@ -1457,7 +1571,7 @@ loaded is either FILE (if given), or the print name of FEATURE.
 	{
 	    dst->imports = Fcons (feature, dst->imports);
 	    Fprovide (feature);
-	    cache_flush ();
+	    imports_changed ();
 	}
     }
     return Qt;
@@ -1697,6 +1811,7 @@ rep_structures_init (void)
     rep_ADD_SUBR (Sstructurep);
     rep_ADD_SUBR (Seval_real);
     rep_ADD_SUBR (Sstructure_walk);
+    rep_ADD_SUBR (Sstructure_cache_statistics);
 #ifdef DEBUG
     rep_ADD_SUBR (Sstructure_stats);
 #endif
@@ -1735,7 +1850,4 @@ rep_structures_init (void)
     Fname_structure (rep_default_structure, Qrep);
     Fname_structure (rep_specials_structure, Q_specials);
     Fname_structure (rep_structures_structure, Q_structures);
-#ifdef DEBUG
-    atexit (print_cache_stats);
-#endif
 }
@@ -47,7 +47,8 @@ char *alloca ();
 #include <stdlib.h>
 #include <assert.h>
 
-/* The number of hash buckets in each rep_obarray, this is a prime number. */
+/* The initial number of hash buckets in each rep_obarray, this is a
+   prime number. They grow as symbols are interned. */
 #define rep_OBSIZE		509
 #define rep_KEY_OBSIZE		127
 
@@ -65,6 +66,29 @@ repv rep_obarray, rep_keyword_obarray;
 /* Plist storage */
 static repv plist_structure;
 
+/* Property lists with more than this many properties are indexed */
+#define PLIST_INDEX_MIN 8
+
+/* An indexed plist is stored as (PLIST_INDEXED . INDEX). INDEX is a
+   vector, element 0 is the plist itself, element 1 the number of
+   properties in the index. The rest are an open-addressed hash table
+   of the plist's symbol properties: each slot is either nil or the
+   cell of the plist whose car is that property.
+
+   Since the list can be changed destructively once `symbol-plist' has
+   returned it, doing so turns the index back into a plain list, and
+   a cell found through the index is checked before it's used. */
+rep_ALIGN_CELL(static rep_cell plist_indexed) = { rep_Void };
+#define PLIST_INDEXED rep_VAL(&plist_indexed)
+#define INDEXED_PLIST_P(v) (rep_CONSP(v) && rep_CAR(v) == PLIST_INDEXED)
+
+#define PLIST_INDEX_LIST(i)	rep_VECTI(i, 0)
+#define PLIST_INDEX_COUNT(i)	rep_VECTI(i, 1)
+#define PLIST_INDEX_SLOTS(i)	(rep_VECT_LEN(i) - 2)
+
+#define PLIST_CELL_VALID_P(cell, prop) \
+    (rep_CAR(cell) == (prop) && rep_CONSP(rep_CDR(cell)))
+
 DEFSYM(t, "t");
 
 DEFSYM(documentation, "documentation");
@@ -226,13 +250,169 @@ rep_intern_static(repv *symp, repv name)
 	abort();
 }
 
+
+/* Hashing */
+
+typedef unsigned rep_long_long hash_word;
+
+#define HASH_K1 0x9e3779b97f4a7c15ULL
+#define HASH_K2 0xc2b2ae3d27d4eb4fULL
+
+static inline hash_word
+hash_rotl (hash_word x, int n)
+{
+    return (x << n) | (x >> (64 - n));
+}
+
+/* Hash LEN bytes from PTR, eight at a time, then avalanche the result
+   so that every input bit affects the low bits. Embedded zero bytes
+   are hashed like any other. */
+unsigned long
+rep_hash_bytes (const void *ptr, size_t len)
+{
+    const unsigned char *p = ptr;
+    hash_word h = len * HASH_K1, w;
+    while (len > 0)
+    {
+	if (len >= sizeof (w))
+	{
+	    memcpy (&w, p, sizeof (w));
+	    p += sizeof (w);
+	    len -= sizeof (w);
+	}
+	else
+	{
+	    w = 0;
+	    memcpy (&w, p, len);
+	    len = 0;
+	}
+	w *= HASH_K2;
+	w = hash_rotl (w, 31);
+	w *= HASH_K1;
+	h ^= w;
+	h = hash_rotl (h, 27) * 5 + 0x52dce729;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/* The hash of a symbol name. It has to fit in the spare bits of a
+   symbol's header word, and zero means `not computed yet'. */
 static inline unsigned long
-hash(char *str)
+name_hash (repv name)
 {
-    register unsigned long value = 0;
-    while(*str)
-	value = (value * 33) + *str++;
-    return(value);
+    unsigned long hv = rep_hash_bytes (rep_STR(name), rep_STRING_LEN(name));
+    hv &= ((unsigned long) -1) >> rep_SYMBOL_HASH_SHIFT;
+    return hv != 0 ? hv : 1;
+}
+
+/* Return the hash of SYM's name, computing and caching it if this is
+   the first time it's been needed */
+unsigned long
+rep_symbol_hash (repv sym)
+{
+    unsigned long hv = rep_SYMBOL_HASH(sym);
+    if (hv == 0)
+    {
+	hv = name_hash (rep_SYM(sym)->name);
+	rep_SYM(sym)->car |= (repv) hv << rep_SYMBOL_HASH_SHIFT;
+    }
+    return hv;
+}
+
+
+/* Obarrays */
+
+/* The default obarrays grow as they fill up, so that their chains stay
+   short. Lisp code may hold on to an obarray vector, so it's kept: once
+   an obarray has grown, element 0 of its vector is the vector of
+   buckets actually used and the rest of its elements are empty.
+   Obarrays created by make-obarray keep their size. COUNT is the number
+   of symbols in VECTOR; if the obarray variable is found to point
+   elsewhere, it's recounted. */
+struct obarray_info {
+    repv *obarray;
+    repv vector;
+    unsigned long count;
+};
+
+static struct obarray_info obarray_infos[2] = {
+    { &rep_obarray, rep_NULL, 0 },
+    { &rep_keyword_obarray, rep_NULL, 0 },
+};
+
+/* grow when there are more symbols than buckets */
+#define OBARRAY_FULL_P(info, buckets) ((info)->count > rep_VECT_LEN(buckets))
+
+/* Return the vector holding the hash buckets of obarray OB */
+static inline repv
+obarray_buckets (repv ob)
+{
+    if (rep_VECT_LEN(ob) > 0 && rep_VECTORP(rep_VECTI(ob, 0)))
+	return rep_VECTI(ob, 0);
+    else
+	return ob;
+}
+
+static struct obarray_info *
+obarray_info (repv ob)
+{
+    int i;
+    for (i = 0; i < 2; i++)
+    {
+	struct obarray_info *info = &obarray_infos[i];
+	if (ob == *info->obarray)
+	{
+	    if (info->vector != ob)
+	    {
+		repv buckets = obarray_buckets (ob);
+		int j, len = rep_VECT_LEN(buckets);
+		info->vector = ob;
+		info->count = 0;
+		for (j = 0; j < len; j++)
+		{
+		    repv chain;
+		    for (chain = rep_VECTI(buckets, j); rep_SYMBOLP(chain);
+			 chain = rep_SYM(chain)->next)
+			info->count++;
+		}
+	    }
+	    return info;
+	}
+    }
+    return 0;
+}
+
+/* Move the symbols of INFO's obarray into a new bucket vector about
+   twice the size, and store that in element 0 of the obarray. */
+static void
+grow_obarray (struct obarray_info *info)
+{
+    repv ob = info->vector, old = obarray_buckets (ob), new;
+    int i, old_size = rep_VECT_LEN(old);
+    int new_size = old_size * 2 + 1;
+
+    new = Fmake_vector (rep_MAKE_INT(new_size), OB_NIL);
+    if (new == rep_NULL)
+	return;
+    for (i = 0; i < old_size; i++)
+    {
+	repv chain = rep_VECTI(old, i);
+	while (rep_SYMBOLP(chain))
+	{
+	    repv next = rep_SYM(chain)->next;
+	    int hashid = rep_symbol_hash (chain) % new_size;
+	    rep_SYM(chain)->next = rep_VECTI(new, hashid);
+	    rep_VECTI(new, hashid) = chain;
+	    chain = next;
+	}
+	rep_VECTI(old, i) = OB_NIL;
+    }
+    rep_VECTI(ob, 0) = new;
 }
 
 DEFUN("make-obarray", Fmake_obarray, Smake_obarray, (repv size), rep_Subr1) /*
@@ -256,16 +436,26 @@ the default `rep_obarray' if nil), or nil if no such symbol exists.
 ::end:: */
 {
     int vsize;
+    unsigned long hv;
+    long len;
     rep_DECLARE1(name, rep_STRINGP);
     if(!rep_VECTORP(ob))
 	ob = rep_obarray;
+    ob = obarray_buckets(ob);
     if((vsize = rep_VECT_LEN(ob)) == 0)
 	return(Qnil);
-    ob = rep_VECT(ob)->array[hash(rep_STR(name)) % vsize];
+    hv = name_hash (name);
+    len = rep_STRING_LEN(name);
+    ob = rep_VECT(ob)->array[hv % vsize];
     while(rep_SYMBOLP(ob))
     {
-	if(!strcmp(rep_STR(name), rep_STR(rep_SYM(ob)->name)))
+	/* interned symbols always have their hash cached */
+	repv sname = rep_SYM(ob)->name;
+	if(rep_SYMBOL_HASH(ob) == hv && rep_STRING_LEN(sname) == len
+	   && memcmp(rep_STR(name), rep_STR(sname), len) == 0)
+	{
 	    return(ob);
+	}
 	ob = rep_SYM(ob)->next;
     }
     return(Qnil);
@@ -282,6 +472,8 @@ somewhere an error is signalled.
 ::end:: */
 {
     int vsize, hashid;
+    repv buckets;
+    struct obarray_info *info;
     rep_DECLARE1(sym, rep_SYMBOLP);
     if(rep_SYM(sym)->next != rep_NULL)
     {
@@ -290,11 +482,18 @@ somewhere an error is signalled.
     }
     if(!rep_VECTORP(ob))
 	ob = rep_obarray;
-    if((vsize = rep_VECT_LEN(ob)) == 0)
+    buckets = obarray_buckets(ob);
+    if((vsize = rep_VECT_LEN(buckets)) == 0)
 	return rep_NULL;
-    hashid = hash(rep_STR(rep_SYM(sym)->name)) % vsize;
-    rep_SYM(sym)->next = rep_VECT(ob)->array[hashid];
-    rep_VECT(ob)->array[hashid] = sym;
+    hashid = rep_symbol_hash(sym) % vsize;
+    rep_SYM(sym)->next = rep_VECT(buckets)->array[hashid];
+    rep_VECT(buckets)->array[hashid] = sym;
+    if((info = obarray_info(ob)) != 0)
+    {
+	info->count++;
+	if(OBARRAY_FULL_P(info, buckets))
+	    grow_obarray(info);
+    }
     return(sym);
 }
 
@@ -325,30 +524,73 @@ unintern SYMBOL [OBARRAY]
 Removes SYMBOL from OBARRAY (or the default). Use this with caution.
 ::end:: */
 {
-    repv list;
+    repv list, buckets;
     int vsize, hashid;
+    rep_bool found = rep_FALSE;
+    struct obarray_info *info;
     rep_DECLARE1(sym, rep_SYMBOLP);
     if(!rep_VECTORP(ob))
 	ob = rep_obarray;
-    if((vsize = rep_VECT_LEN(ob)) == 0)
+    buckets = obarray_buckets(ob);
+    if((vsize = rep_VECT_LEN(buckets)) == 0)
 	return rep_NULL;
-    hashid = hash(rep_STR(rep_SYM(sym)->name)) % vsize;
-    list = rep_VECT(ob)->array[hashid];
-    rep_VECT(ob)->array[hashid] = OB_NIL;
+    hashid = rep_symbol_hash(sym) % vsize;
+    list = rep_VECT(buckets)->array[hashid];
+    rep_VECT(buckets)->array[hashid] = OB_NIL;
     while(rep_SYMBOLP(list))
     {
 	repv nxt = rep_SYM(list)->next;
 	if(list != sym)
 	{
-	    rep_SYM(list)->next = rep_VECT(ob)->array[hashid];
-	    rep_VECT(ob)->array[hashid] = rep_VAL(list);
+	    rep_SYM(list)->next = rep_VECT(buckets)->array[hashid];
+	    rep_VECT(buckets)->array[hashid] = rep_VAL(list);
 	}
+	else
+	    found = rep_TRUE;
 	list = nxt;
     }
     rep_SYM(sym)->next = rep_NULL;
+    if(found && (info = obarray_info(ob)) != 0)
+	info->count--;
     return(sym);
 }
 
+DEFUN("obarray-statistics", Fobarray_statistics, Sobarray_statistics,
+      (repv ob), rep_Subr1) /*
+::doc:rep.lang.symbols#obarray-statistics::
+obarray-statistics [OBARRAY]
+
+Return a list `(SYMBOLS BUCKETS USED-BUCKETS LONGEST-CHAIN)' describing
+OBARRAY (or the default). SYMBOLS divided by BUCKETS is the load factor
+of the obarray, and SYMBOLS divided by USED-BUCKETS the average length
+of the non-empty chains.
+::end:: */
+{
+    int i, vsize, used = 0, longest = 0;
+    unsigned long count = 0;
+    if(!rep_VECTORP(ob))
+	ob = rep_obarray;
+    ob = obarray_buckets(ob);
+    vsize = rep_VECT_LEN(ob);
+    for(i = 0; i < vsize; i++)
+    {
+	repv chain = rep_VECTI(ob, i);
+	int length = 0;
+	while(rep_SYMBOLP(chain))
+	{
+	    length++;
+	    chain = rep_SYM(chain)->next;
+	}
+	if(length > 0)
+	    used++;
+	if(length > longest)
+	    longest = length;
+	count += length;
+    }
+    return rep_list_4(rep_make_long_uint(count), rep_MAKE_INT(vsize),
+		      rep_MAKE_INT(used), rep_MAKE_INT(longest));
+}
+
 
 /* Closures */
 
@@ -398,6 +640,11 @@ Return the function value associated with the closure FUNARG.
 ::end:: */
 {
     rep_DECLARE1(funarg, rep_FUNARGP);
+    if (rep_lazy_function_p (rep_FUNARG(funarg)->fun)
+	&& !rep_load_lazy_function (funarg))
+    {
+	return rep_NULL;
+    }
     return rep_FUNARG(funarg)->fun;
 }
 
@@ -515,23 +762,11 @@ search_environment (repv sym)
     return Qnil;
 }
 
-/* this is also in lispmach.c and fluids.c */
-static inline repv
-inlined_search_special_bindings (repv sym)
+/* Returns true if SYM has a lexical binding in the current environment */
+rep_bool
+rep_lexically_bound_p (repv sym)
 {
-    register repv env;
-    for (env = rep_special_bindings; env != Qnil; env = rep_CDR (env))
-    {
-	if (rep_CAAR(env) == sym)
-	    return rep_CAR (env);
-    }
-    return Qnil;
-}
-
-static repv
-search_special_bindings (repv sym)
-{
-    return inlined_search_special_bindings (sym);
+    return search_environment (sym) != Qnil;
 }
 
 static inline int
@@ -583,13 +818,104 @@ rep_call_with_closure (repv closure, repv (*fun)(repv arg), repv arg)
 
 /* Symbol binding */
 
+/* Special variables are shallow bound. The current value of each
+   special lives in its value cell (its binding in the specials
+   structure), and rep_special_bindings is a stack of (SYMBOL . VALUE)
+   entries. While an entry is in effect its cdr holds the value that
+   the binding shadows; binding and unbinding both exchange the cell
+   with the entry, so an entry that has been unwound holds the value
+   of its own binding. Continuations re-enter a saved stack by
+   exchanging its entries again (see rep_reroot_special_bindings).
+
+   Entries whose car isn't a symbol are fluid bindings, the value cell
+   of a fluid is its own cdr (see fluids.c). */
+
+static inline void
+swap_special_binding (repv entry)
+{
+    repv var = rep_CAR (entry);
+    repv *cell = (rep_SYMBOLP (var) ? rep_special_value_cell (var)
+		  : &rep_CDR (var));
+    repv tem = *cell;
+    *cell = rep_CDR (entry);
+    rep_CDR (entry) = tem;
+}
+
+/* Pop the COUNT most recent special bindings. */
+void
+rep_unbind_specials (int count)
+{
+    repv tem = rep_special_bindings;
+    while (count-- > 0)
+    {
+	swap_special_binding (rep_CAR (tem));
+	tem = rep_CDR (tem);
+    }
+    rep_special_bindings = tem;
+}
+
+/* Pop special bindings until TO (a tail of the stack) is reached. */
+void
+rep_unwind_special_bindings (repv to)
+{
+    repv tem = rep_special_bindings;
+    while (tem != to)
+    {
+	swap_special_binding (rep_CAR (tem));
+	tem = rep_CDR (tem);
+    }
+    rep_special_bindings = tem;
+}
+
+/* Make TARGET the current stack of special bindings, unwinding the
+   current stack to the tail it shares with TARGET, then reinstating
+   the entries of TARGET above that tail, oldest first. */
+void
+rep_reroot_special_bindings (repv target)
+{
+    repv cur = rep_special_bindings, tem;
+    int cur_len = rep_list_length (cur);
+    int target_len = rep_list_length (target);
+    int i, count;
+    repv *entries;
+
+    tem = target;
+    for (; cur_len > target_len; cur_len--)
+	cur = rep_CDR (cur);
+    for (; target_len > cur_len; target_len--)
+	tem = rep_CDR (tem);
+    while (cur != tem)
+    {
+	cur = rep_CDR (cur);
+	tem = rep_CDR (tem);
+    }
+
+    rep_unwind_special_bindings (cur);
+
+    count = 0;
+    for (tem = target; tem != cur; tem = rep_CDR (tem))
+	count++;
+    if (count > 0)
+    {
+	entries = alloca (sizeof (repv) * count);
+	i = 0;
+	for (tem = target; tem != cur; tem = rep_CDR (tem))
+	    entries[i++] = rep_CAR (tem);
+	while (i-- > 0)
+	    swap_special_binding (entries[i]);
+    }
+    rep_special_bindings = target;
+}
+
 repv
 rep_bind_special (repv oldList, repv symbol, repv newVal)
 {
     if (inlined_search_special_environment (symbol))
     {
-	rep_special_bindings = Fcons (Fcons (symbol, newVal),
+	repv *cell = rep_special_value_cell (symbol);
+	rep_special_bindings = Fcons (Fcons (symbol, *cell),
 				      rep_special_bindings);
+	*cell = newVal;
 	oldList = rep_MARK_SPEC_BINDING (oldList);
     }
     else
@@ -640,12 +966,8 @@ rep_unbind_symbols(repv oldList)
 	    tem = rep_CDR (tem);
 	rep_env = tem;
 
-	tem = rep_special_bindings;
-	for (i = specials; i > 0; i--)
-	{
-	    tem = rep_CDR (tem);
-	}
-	rep_special_bindings = tem;
+	if (specials > 0)
+	    rep_unbind_specials (specials);
 
 	assert (rep_special_bindings != rep_void_value);
 	assert (rep_env != rep_void_value);
@@ -834,13 +1156,7 @@ values look for one of those first.
 	    if(rep_SYM(sym)->car & rep_SF_LOCAL)
 		val = (*rep_deref_local_symbol_fun)(sym);
 	    if (val == rep_void_value)
-	    {
-		repv tem = inlined_search_special_bindings (sym);
-		if (tem != Qnil)
-		    val = rep_CDR (tem);
-		else
-		    val = F_structure_ref (rep_specials_structure, sym);
-	    }
+		val = F_structure_ref (rep_specials_structure, sym);
 	}
     }
     else
@@ -878,13 +1194,7 @@ SYMBOL in buffers or windows which do not have their own local value.
     {
 	int spec = search_special_environment (sym);
 	if (spec < 0 || (spec > 0 && !(rep_SYM(sym)->car & rep_SF_WEAK_MOD)))
-	{
-	    repv tem = search_special_bindings (sym);
-	    if (tem != Qnil)
-		val = rep_CDR (tem);
-	    else
-		val = F_structure_ref (rep_specials_structure, sym);
-	}
+	    val = F_structure_ref (rep_specials_structure, sym);
     }
     else
 	val = F_structure_ref (rep_structure, sym);
@@ -907,8 +1217,6 @@ do_set (repv sym, repv val, repv (*setter)(repv st, repv var, repv val))
 	int spec = inlined_search_special_environment (sym);
 	if (spec)
 	{
-	    repv tem;
-
 	    /* Not allowed to set `modified' variables unless
 	       our environment includes all variables implicitly */
 	    if (spec > 0 && rep_SYM(sym)->car & rep_SF_WEAK_MOD)
@@ -921,11 +1229,7 @@ do_set (repv sym, repv val, repv (*setter)(repv st, repv var, repv val))
 		    return tem;
 		/* Fall through and set the default value. */
 	    }
-	    tem = inlined_search_special_bindings (sym);
-	    if (tem != Qnil)
-		rep_CDR (tem) = val;
-	    else
-		val = Fstructure_define (rep_specials_structure, sym, val);
+	    *rep_special_value_cell (sym) = val;
 	}
 	else
 	    val = Fsignal (Qvoid_value, rep_LIST_1(sym));	/* XXX */
@@ -972,16 +1276,10 @@ Sets the default value of SYMBOL to VALUE, then returns VALUE.
 	int spec = search_special_environment (sym);
 	if (spec)
 	{
-	    repv tem;
-
 	    if (spec > 0 && rep_SYM(sym)->car & rep_SF_WEAK_MOD)
 		return Fsignal (Qvoid_value, rep_LIST_1(sym));	/* XXX */
 
-	    tem = search_special_bindings (sym);
-	    if (tem != Qnil)
-		rep_CDR (tem) = val;
-	    else
-		val = Fstructure_define (rep_specials_structure, sym, val);
+	    *rep_special_value_cell (sym) = val;
 	}
 	else
 	    return Fsignal (Qvoid_value, rep_LIST_1(sym));	/* XXX */
@@ -1029,14 +1327,8 @@ Returns t if SYMBOL has a default value.
     rep_DECLARE1(sym, rep_SYMBOLP);
     if (rep_SYM(sym)->car & rep_SF_SPECIAL)
     {
-	repv tem = search_special_bindings (sym);
-	if (tem != Qnil)
-	    return rep_VOIDP (rep_CDR (tem)) ? Qnil : Qt;
-	else
-	{
-	    tem = F_structure_ref (rep_specials_structure, sym);
-	    return rep_VOIDP (tem) ? Qnil : Qt;
-	}
+	repv tem = F_structure_ref (rep_specials_structure, sym);
+	return rep_VOIDP (tem) ? Qnil : Qt;
     }
     else
 	return Fstructure_bound_p (rep_structure, sym);
@@ -1057,7 +1349,9 @@ DEFUN("symbol-plist", Fsymbol_plist, Ssymbol_plist, (repv sym), rep_Subr1) /*
 ::doc:rep.lang.symbols#symbol-plist::
 symbol-plist SYMBOL
 
-Returns the property-list of SYMBOL.
+Returns the property-list of SYMBOL. Changes made to it destructively
+are seen by `get' and `put' until one of `put' or `setplist' is next
+called with SYMBOL.
 ::end:: */
 {
     int spec;
@@ -1068,6 +1362,13 @@ Returns the property-list of SYMBOL.
 	return Fsignal (Qvoid_value, rep_LIST_1(sym));	/* XXX */
 
     plist = F_structure_ref (plist_structure, sym);
+    if (INDEXED_PLIST_P (plist))
+    {
+	/* the caller may modify the list, so stop indexing it */
+	plist = PLIST_INDEX_LIST(rep_CDR(plist));
+	Fstructure_define (plist_structure, sym, plist);
+	return plist;
+    }
     return rep_VOIDP (plist) ? Qnil : plist;
 }
 
@@ -1175,6 +1476,54 @@ Make SYMBOL have no value as a variable.
     return Freal_set (sym, rep_void_value);
 }
 
+/* Return the slot of plist index INDEX that holds, or would hold,
+   the cell for symbol PROP. */
+static repv *
+plist_index_slot (repv index, repv prop)
+{
+    unsigned long mask = PLIST_INDEX_SLOTS(index) - 1;
+    unsigned long i = rep_symbol_hash (prop) & mask;
+    while (1)
+    {
+	repv *slot = &rep_VECTI(index, i + 2);
+	if (*slot == Qnil || rep_CAR(*slot) == prop)
+	    return slot;
+	i = (i + 1) & mask;
+    }
+}
+
+/* Return a new index of PLIST, which has about COUNT properties. If
+   a property occurs more than once, only its first cell is indexed,
+   as that's the one get finds. */
+static repv
+make_plist_index (repv plist, int count)
+{
+    int size = 16;
+    repv index;
+    while (size < count * 2)
+	size *= 2;
+    index = Fmake_vector (rep_MAKE_INT(size + 2), Qnil);
+    if (index == rep_NULL)
+	return rep_NULL;
+    PLIST_INDEX_LIST(index) = plist;
+    PLIST_INDEX_COUNT(index) = rep_MAKE_INT(0);
+    for (; rep_CONSP(plist) && rep_CONSP(rep_CDR(plist));
+	 plist = rep_CDR(rep_CDR(plist)))
+    {
+	if (rep_SYMBOLP(rep_CAR(plist)))
+	{
+	    repv *slot = plist_index_slot (index, rep_CAR(plist));
+	    if (*slot == Qnil)
+	    {
+		*slot = plist;
+		PLIST_INDEX_COUNT(index)
+		    = rep_MAKE_INT(rep_INT(PLIST_INDEX_COUNT(index)) + 1);
+	    }
+	}
+    }
+    return index;
+}
+
 DEFUN("get", Fget, Sget, (repv sym, repv prop), rep_Subr2) /*
 ::doc:rep.lang.symbols#get::
 get SYMBOL PROPERTY
@@ -1187,6 +1536,19 @@ Returns the value of SYMBOL's property PROPERTY. See `put'.
     plist = F_structure_ref (plist_structure, sym);
     if (rep_VOIDP (plist))
 	return Qnil;
+    if (INDEXED_PLIST_P (plist))
+    {
+	repv index = rep_CDR(plist);
+	if (rep_SYMBOLP(prop))
+	{
+	    repv cell = *plist_index_slot (index, prop);
+	    if (cell == Qnil)
+		return Qnil;
+	    else if (PLIST_CELL_VALID_P (cell, prop))
+		return rep_CAR(rep_CDR(cell));
+	}
+	plist = PLIST_INDEX_LIST(index);
+    }
     while(rep_CONSP(plist) && rep_CONSP(rep_CDR(plist)))
     {
 	if(rep_CAR(plist) == prop
@@ -1208,16 +1570,54 @@ Sets the value of SYMBOL's property PROPERTY to repv, this value can be
 retrieved with the `get' function.
 ::end:: */
 {
-    repv plist, old;
-    int spec;
+    repv plist, old, stored, index = rep_NULL;
+    int spec, count = 0;
     rep_DECLARE1(sym, rep_SYMBOLP);
     spec = search_special_environment (sym);
     if (spec == 0)
 	return Fsignal (Qvoid_value, rep_LIST_1(sym));	/* XXX */
 
-    old = F_structure_ref (plist_structure, sym);
-    if (rep_VOIDP (old))
-	old = Qnil;
+    stored = F_structure_ref (plist_structure, sym);
+    old = rep_VOIDP (stored) ? Qnil : stored;
+    if (INDEXED_PLIST_P (old))
+    {
+	index = rep_CDR(old);
+	old = PLIST_INDEX_LIST(index);
+	if (rep_SYMBOLP(prop))
+	{
+	    repv *slot = plist_index_slot (index, prop);
+	    int n = rep_INT(PLIST_INDEX_COUNT(index));
+	    if (*slot != Qnil && !PLIST_CELL_VALID_P (*slot, prop))
+	    {
+		index = make_plist_index (old, n);
+		if (index == rep_NULL)
+		    return rep_NULL;
+		rep_CDR(stored) = index;
+		slot = plist_index_slot (index, prop);
+		n = rep_INT(PLIST_INDEX_COUNT(index));
+	    }
+	    if (*slot != Qnil && rep_CONS_WRITABLE_P(rep_CDR(*slot)))
+	    {
+		rep_CAR(rep_CDR(*slot)) = val;
+		return val;
+	    }
+
+	    /* add a new cell at the head of the list, and index it */
+	    plist = Fcons (prop, Fcons (val, old));
+	    PLIST_INDEX_LIST(index) = plist;
+	    if (*slot == Qnil)
+		PLIST_INDEX_COUNT(index) = rep_MAKE_INT(++n);
+	    *slot = plist;
+	    if (n * 2 > PLIST_INDEX_SLOTS(index))
+	    {
+		index = make_plist_index (plist, n);
+		if (index != rep_NULL)
+		    rep_CDR(stored) = index;
+	    }
+	    return val;
+	}
+    }
+
     plist = old;
     while(rep_CONSP(plist) && rep_CONSP(rep_CDR(plist)))
     {
@@ -1235,8 +1635,20 @@ retrieved with the `get' function.
 	    return val;
 	}
 	plist = rep_CDR(rep_CDR(plist));
+	count++;
     }
-    Fstructure_define (plist_structure, sym, Fcons (prop, Fcons (val, old)));
+
+    plist = Fcons (prop, Fcons (val, old));
+    if (index != rep_NULL)
+	PLIST_INDEX_LIST(index) = plist;
+    else if (count >= PLIST_INDEX_MIN
+	     && (index = make_plist_index (plist, count + 1)) != rep_NULL)
+    {
+	Fstructure_define (plist_structure, sym,
+			   Fcons (PLIST_INDEXED, index));
+    }
+    else
+	Fstructure_define (plist_structure, sym, plist);
     return val;
 }
 
@@ -1257,36 +1669,44 @@ is non-nil it is considered a match.
     prog = rep_regcomp(rep_STR(re));
     if(prog)
     {
-	repv last = Qnil;
-	int i, len = rep_VECT_LEN(ob);
-	rep_GC_root gc_last, gc_ob, gc_pred;
-	rep_PUSHGC(gc_last, last);
-	rep_PUSHGC(gc_ob, ob);
-	rep_PUSHGC(gc_pred, pred);
+	repv last = Qnil, *ptr;
+	int i, len;
+	rep_GC_root gc_last, gc_pred;
+	/* Collect the matches before calling PREDICATE, since it may
+	   intern symbols and make the obarray grow */
+	ob = obarray_buckets(ob);
+	len = rep_VECT_LEN(ob);
 	for(i = 0; i < len; i++)
 	{
 	    repv chain = rep_VECT(ob)->array[i];
 	    while(rep_SYMBOLP(chain))
 	    {
 		if(rep_regexec(prog, rep_STR(rep_SYM(chain)->name)))
-		{
-		    if(pred && !rep_NILP(pred))
-		    {
-			repv tmp;
-			if(!(tmp = rep_funcall(pred, rep_LIST_1(chain), rep_FALSE))
-			   || rep_NILP(tmp))
-			{
-			    goto next;
-			}
-		    }
 		    last = Fcons(chain, last);
-		}
-next:
 		chain = rep_SYM(chain)->next;
 	    }
 	}
-	rep_POPGC; rep_POPGC; rep_POPGC;
 	free(prog);
+	if(pred && !rep_NILP(pred))
+	{
+	    rep_PUSHGC(gc_last, last);
+	    rep_PUSHGC(gc_pred, pred);
+	    ptr = &last;
+	    while(rep_CONSP(*ptr))
+	    {
+		repv tmp = rep_funcall(pred, rep_LIST_1(rep_CAR(*ptr)), rep_FALSE);
+		if(tmp == rep_NULL)
+		{
+		    last = rep_NULL;
+		    break;
+		}
+		if(rep_NILP(tmp))
+		    *ptr = rep_CDR(*ptr);
+		else
+		    ptr = rep_CDRLOC(*ptr);
+	    }
+	    rep_POPGC; rep_POPGC;
+	}
 	return(last);
     }
     return rep_NULL;
@@ -1481,6 +1901,7 @@ rep_symbols_init(void)
     rep_ADD_SUBR(Smake_variable_special);
     rep_ADD_SUBR(Sspecial_variable_p);
     rep_ADD_SUBR(Sobarray);
+    rep_ADD_SUBR(Sobarray_statistics);
     rep_ADD_SUBR(Smake_keyword);
     rep_ADD_SUBR(Skeywordp);
     rep_pop_structure (tem);
@@ -33,22 +33,50 @@
 
 typedef unsigned rep_PTR_SIZED_INT hash_value;
 
-typedef struct node_struct node;
-struct node_struct {
-    node *next;
+/* Tables use open addressing with linear probing, ordered by the
+   Robin Hood rule: an entry being inserted displaces any entry that
+   is closer to its home slot than the new one is. Each entry records
+   its distance from its home slot (plus one, zero marks an empty
+   slot), so a lookup can stop as soon as it reaches an entry nearer
+   home than the key being searched for would be. Removal shifts the
+   following entries back, so no tombstones are needed. */
+
+typedef struct entry_struct entry;
+struct entry_struct {
     repv key, value;
     hash_value hash;
+    unsigned int distance;
+};
+
+/* How the hash and compare functions are called; for the builtin
+   functions the work is done inline, anything else is called
+   through Lisp. */
+enum hash_type {
+    HASH_LISP = 0, HASH_STRING, HASH_SYMBOL, HASH_EQ, HASH_EQUAL
+};
+
+enum compare_type {
+    COMPARE_LISP = 0, COMPARE_EQ, COMPARE_EQL, COMPARE_EQUAL
 };
 
 typedef struct table_struct table;
 struct table_struct {
     repv car;
     table *next;
-    int total_buckets, total_nodes;
-    node **buckets;
+    int total_slots, total_nodes;	/* total_slots is 0 or 2^N */
+    entry *slots;
+
+    /* While the table is being resized, entries not yet moved into
+       SLOTS. Slots before index MIGRATED have already been moved. */
+    entry *old_slots;
+    int old_total_slots, old_nodes, migrated;
+
     repv hash_fun;
     repv compare_fun;
-    repv guardian;			/* non-null if a weak table */
+    rep_bool weak;			/* keys don't keep entries alive */
+    enum hash_type hash_type;
+    enum compare_type compare_type;
+    unsigned int changes;		/* bumped by each insert or remove */
 };
 
 #define TABLEP(v) rep_CELL16_TYPEP(v, table_type)
@@ -57,46 +85,152 @@ struct table_struct {
 static int table_type;
 static table *all_tables;
 
+/* A position in a table, see table-cursor. INDEX is the slot of the
+   entry last returned (or -1), KEY its key and CHANGES the value of
+   the table's change count at the time. */
+typedef struct cursor_struct cursor;
+struct cursor_struct {
+    repv car;
+    cursor *next;
+    repv table;
+    int index;
+    repv key;
+    unsigned int changes;
+};
+
+#define CURSORP(v) rep_CELL16_TYPEP(v, cursor_type)
+#define CURSOR(v)  ((cursor *) rep_PTR(v))
+
+static int cursor_type;
+static cursor *all_cursors;
+
 /* ensure X is +ve and in an int */
 #define TRUNC(x) (((x) << (rep_VALUE_INT_SHIFT+1)) >> (rep_VALUE_INT_SHIFT+1))
 
+/* grow the table when it gets more than three-quarters full */
+#define SLOTS_FULL_P(nodes, slots) (((nodes) + 1) * 4 > (slots) * 3)
+#define TABLE_FULL_P(t) \
+    SLOTS_FULL_P ((t)->total_nodes - (t)->old_nodes, (t)->total_slots)
+
+/* tables with at least this many slots are resized incrementally */
+#define INCREMENTAL_RESIZE_SLOTS 1024
+
+/* number of old slots moved by each access during a resize. The new
+   array has twice as many slots, so this is enough to finish before
+   it needs to grow again */
+#define MIGRATE_STEP 8
+
 
 /* type hooks */
 
 static void
-table_mark (repv val)
+mark_slots (entry *slots, int total)
 {
     int i;
-    for (i = 0; i < TABLE(val)->total_buckets; i++)
+    for (i = 0; i < total; i++)
     {
-	node *n;
-	for (n = TABLE(val)->buckets[i]; n != 0; n = n->next)
+	entry *e = &slots[i];
+	if (e->distance != 0)
 	{
-	    if (!TABLE(val)->guardian)
-		rep_MARKVAL(n->key);
-	    rep_MARKVAL(n->value);
+	    rep_MARKVAL(e->key);
+	    rep_MARKVAL(e->value);
 	}
     }
+}
+
+static void
+table_mark (repv val)
+{
+    /* the entries of weak tables are marked by mark_weak_tables () */
+    if (!TABLE(val)->weak)
+    {
+	mark_slots (TABLE(val)->slots, TABLE(val)->total_slots);
+	if (TABLE(val)->old_slots != 0)
+	    mark_slots (TABLE(val)->old_slots, TABLE(val)->old_total_slots);
+    }
     rep_MARKVAL(TABLE(val)->hash_fun);
     rep_MARKVAL(TABLE(val)->compare_fun);
-    rep_MARKVAL(TABLE(val)->guardian);
 }
 
+/* Weak tables hold their entries as ephemerons: the value of an entry
+   is only marked once its key is known to be live, and an entry whose
+   key isn't marked by the end of the mark phase is removed. So a value
+   that refers back to its own key doesn't keep the entry alive. */
+
+static rep_bool
+mark_weak_slots (entry *slots, int total)
+{
+    rep_bool marked = rep_FALSE;
+    int i;
+    for (i = 0; i < total; i++)
+    {
+	entry *e = &slots[i];
+	if (e->distance != 0 && !rep_gc_live_p (e->value)
+	    && rep_gc_live_p (e->key))
+	{
+	    rep_MARKVAL(e->value);
+	    marked = rep_TRUE;
+	}
+    }
+    return marked;
+}
+
+static rep_bool
+mark_weak_tables (void)
+{
+    rep_bool marked = rep_FALSE;
+    table *x;
+    for (x = all_tables; x != 0; x = x->next)
+    {
+	if (x->weak && rep_GC_CELL_MARKEDP (rep_VAL(x)))
+	{
+	    if (mark_weak_slots (x->slots, x->total_slots))
+		marked = rep_TRUE;
+	    if (x->old_slots != 0
+		&& mark_weak_slots (x->old_slots, x->old_total_slots))
+		marked = rep_TRUE;
+	}
+    }
+    return marked;
+}
+
+static void remove_entry (table *t, entry *e);
+
 static void
-free_table (table *x)
+prune_weak_slots (table *t, entry *slots, int total)
 {
     int i;
-    for (i = 0; i < x->total_buckets; i++)
+    for (i = 0; i < total; i++)
     {
-	node *n, *next;
-	for (n = x->buckets[i]; n != 0; n = next)
+	/* removing an entry may shift the next one back into this
+	   slot, so look at it again */
+	while (slots[i].distance != 0 && !rep_gc_live_p (slots[i].key))
+	    remove_entry (t, &slots[i]);
+    }
+}
+
+static void
+prune_weak_tables (void)
+{
+    table *x;
+    for (x = all_tables; x != 0; x = x->next)
+    {
+	if (x->weak && rep_GC_CELL_MARKEDP (rep_VAL(x)))
 	{
-	    next = n->next;
-	    rep_free (n);
+	    prune_weak_slots (x, x->slots, x->total_slots);
+	    if (x->old_slots != 0)
+		prune_weak_slots (x, x->old_slots, x->old_total_slots);
 	}
     }
-    if (x->total_buckets > 0)
-	rep_free (x->buckets);
+}
+
+static void
+free_table (table *x)
+{
+    if (x->total_slots > 0)
+	rep_free (x->slots);
+    if (x->old_slots != 0)
+	rep_free (x->old_slots);
     rep_FREE_CELL (x);
 }
 
@@ -130,16 +264,88 @@ table_print (repv stream, repv arg)
     rep_stream_putc (stream, '>');
 }
 
+static void
+cursor_mark (repv val)
+{
+    rep_MARKVAL(CURSOR(val)->table);
+    rep_MARKVAL(CURSOR(val)->key);
+}
+
+static void
+cursor_sweep (void)
+{
+    cursor *x = all_cursors;
+    all_cursors = 0;
+    while (x != 0)
+    {
+	cursor *next = x->next;
+	if (!rep_GC_CELL_MARKEDP (rep_VAL(x)))
+	    rep_FREE_CELL (x);
+	else
+	{
+	    rep_GC_CLR_CELL (rep_VAL(x));
+	    x->next = all_cursors;
+	    all_cursors = x;
+	}
+	x = next;
+    }
+}
+
+static void
+cursor_print (repv stream, repv arg)
+{
+    rep_stream_puts (stream, "#<table-cursor>", -1, rep_FALSE);
+}
+
 
 /* hash functions */
 
+typedef unsigned rep_long_long hash_word;
+
+#define HASH_K1 0x9e3779b97f4a7c15ULL
+#define HASH_K2 0xc2b2ae3d27d4eb4fULL
+
+static inline hash_word
+hash_rotl (hash_word x, int n)
+{
+    return (x << n) | (x >> (64 - n));
+}
+
+/* Fold one word into the running hash H. */
+static inline hash_word
+hash_step (hash_word h, hash_word w)
+{
+    w *= HASH_K2;
+    w = hash_rotl (w, 31);
+    w *= HASH_K1;
+    h ^= w;
+    return hash_rotl (h, 27) * 5 + 0x52dce729;
+}
+
+/* Avalanche the bits of H, so that every input bit affects the low
+   bits used to choose a slot. */
+static inline hash_word
+hash_finish (hash_word h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
 static inline hash_value
-hash_string (register char *ptr)
+hash_string (repv string)
 {
-    register hash_value value = 0;
-    while (*ptr != 0)
-	value = (value * 33) + *ptr++;
-    return rep_MAKE_INT (TRUNC (value));
+    return rep_hash_bytes (rep_STR (string), rep_STRING_LEN (string));
+}
+
+static inline hash_value
+hash_symbol (repv sym)
+{
+    hash_value hv = rep_SYMBOL_HASH (sym);
+    return hv != 0 ? hv : rep_symbol_hash (sym);
 }
 
 DEFUN("string-hash", Fstring_hash, Sstring_hash, (repv string), rep_Subr1) /*
@@ -151,7 +357,7 @@ such that (string= X Y) implies (= (string-hash X) (string-hash Y)).
 ::end:: */
 {
     rep_DECLARE1(string, rep_STRINGP);
-    return hash_string (rep_STR (string));
+    return rep_MAKE_INT (TRUNC (hash_string (string)));
 }
 
 DEFUN("symbol-hash", Fsymbol_hash, Ssymbol_hash, (repv sym), rep_Subr1) /*
@@ -162,7 +368,7 @@ Return a positive fixnum somehow related to the name of SYMBOL.
 ::end:: */
 {
     rep_DECLARE1(sym, rep_SYMBOLP);
-    return hash_string (rep_STR (rep_SYM (sym)->name));
+    return rep_MAKE_INT (TRUNC (hash_symbol (sym)));
 }
 
 DEFUN("eq-hash", Feq_hash, Seq_hash, (repv value), rep_Subr1) /*
@@ -177,68 +383,86 @@ Y) implies (= (eq-hash X) (eq-hash Y)).
     return rep_MAKE_INT (TRUNC (hv));
 }
 
-/* XXX This is probably _very_ sub-optimal.. */
-DEFUN("equal-hash", Fequal_hash, Sequal_hash, (repv x, repv n_), rep_Subr2) /*
-::doc:rep.data.tables#equal-hash::
-equal-hash ARG
+/* The number of objects equal-hash looks at by default, and the most
+   it will queue while walking a structure. Anything past either limit
+   is ignored, which is safe since equal objects are always walked in
+   the same order. */
+#define EQUAL_HASH_BUDGET 64
+#define EQUAL_HASH_STACK 32
 
-Return a positive fixnum somehow related to ARG, such that (equal X Y)
-implies (= (equal-hash X) (equal-hash Y)).
-::end:: */
+static hash_value
+equal_hash (repv x, int budget)
 {
-    int n = rep_INTP (n_) ? rep_INT (n_) : rep_PTR_SIZED_INT_BITS / 2;
-    if (rep_CONSP (x))
+    repv stack[EQUAL_HASH_STACK];
+    int sp = 0;
+    hash_word h = 0;
+
+    stack[sp++] = x;
+    while (sp > 0 && budget-- > 0)
     {
-	if (n > 0)
+	x = stack[--sp];
+	if (rep_CONSP (x))
 	{
-	    repv left = Fequal_hash (rep_CAR(x), rep_MAKE_INT (n/2));
-	    repv right = Fequal_hash (rep_CDR(x), rep_MAKE_INT (n/2));
-	    return rep_MAKE_INT ((rep_INT (left) << 1) + rep_INT (right));
+	    h = hash_step (h, rep_Cons);
+	    if (sp < EQUAL_HASH_STACK)
+		stack[sp++] = rep_CDR (x);
+	    if (sp < EQUAL_HASH_STACK)
+		stack[sp++] = rep_CAR (x);
 	}
-	else
-	    return rep_MAKE_INT (rep_Cons);
-    }
-    else if (rep_VECTORP (x) || rep_COMPILEDP (x))
-    {
-	hash_value hash = 0;
-	int i = MIN (n, rep_VECT_LEN (x));
-	while (i-- > 0)
+	else if (rep_VECTORP (x) || rep_COMPILEDP (x))
 	{
-	    repv tem = Fequal_hash (rep_VECTI (x, i), rep_MAKE_INT (n/2));
-	    hash = hash * 33 + rep_INT (tem);
+	    int i = rep_VECT_LEN (x);
+	    h = hash_step (h, i);
+	    /* Push from the end, so the first element is walked first */
+	    if (i > EQUAL_HASH_STACK - sp)
+		i = EQUAL_HASH_STACK - sp;
+	    while (i-- > 0)
+		stack[sp++] = rep_VECTI (x, i);
 	}
-	return rep_MAKE_INT (TRUNC (hash));
-    }
-    else if (rep_STRINGP (x))
-	return Fstring_hash (x);
-    else if (rep_SYMBOLP (x))
-	return Fsymbol_hash (x);
-    else if (rep_INTP (x))
-    {
-	hash_value hash = rep_INT (x);
-	return rep_MAKE_INT (TRUNC (hash));
-    }
-    else if (rep_NUMBERP (x))
-    {
-	hash_value hash = rep_get_long_uint (x);
-	return rep_MAKE_INT (TRUNC (hash));
+	else if (rep_STRINGP (x))
+	    h = hash_step (h, hash_string (x));
+	else if (rep_SYMBOLP (x))
+	    h = hash_step (h, hash_symbol (x));
+	else if (rep_INTP (x))
+	    h = hash_step (h, rep_INT (x));
+	else if (rep_NUMBERP (x))
+	    h = hash_step (h, rep_get_long_uint (x));
+	else
+	    h = hash_step (h, rep_TYPE (x));
     }
-    else
-	return rep_MAKE_INT (rep_TYPE (x) * 255);
+    return hash_finish (h);
+}
+
+DEFUN("equal-hash", Fequal_hash, Sequal_hash, (repv x, repv n_), rep_Subr2) /*
+::doc:rep.data.tables#equal-hash::
+equal-hash ARG
+
+Return a positive fixnum somehow related to ARG, such that (equal X Y)
+implies (= (equal-hash X) (equal-hash Y)).
+::end:: */
+{
+    int n = rep_INTP (n_) ? rep_INT (n_) : EQUAL_HASH_BUDGET;
+    return rep_MAKE_INT (TRUNC (equal_hash (x, n)));
 }
 
 
 /* table functions */
 
+static int slots_for_count (unsigned long count);
+static void resize_table (table *t, int new_size, rep_bool incremental);
+
 DEFUN("make-table", Fmake_table, Smake_table,
-      (repv hash_fun, repv cmp_fun, repv is_weak), rep_Subr3) /*
+      (repv hash_fun, repv cmp_fun, repv is_weak, repv size), rep_Subr4) /*
 ::doc:rep.data.tables#make-table::
-make-table HASH-FUNCTION COMPARE-FUNCTION
+make-table HASH-FUNCTION COMPARE-FUNCTION [WEAK] [SIZE]
 
 Create and return a new hash table. When storing and referencing keys
 it will use the function HASH-FUNCTION to map keys to hash codes
 (positive fixnums), and the predicate function COMPARE-FUNCTION to
 compare two keys (should return true if the keys are considered equal).
+
+If SIZE is an integer, the table is created large enough to hold that
+many entries without being resized.
 ::end:: */
 {
     table *tab;
@@ -252,17 +476,47 @@ compare two keys (should return true if the keys are considered equal).
     all_tables = tab;
     tab->hash_fun = hash_fun;
     tab->compare_fun = cmp_fun;
-    tab->total_buckets = 0;
+    tab->total_slots = 0;
     tab->total_nodes = 0;
-    tab->guardian = (is_weak == Qnil) ? rep_NULL : Fmake_primitive_guardian ();
+    tab->slots = 0;
+    tab->old_slots = 0;
+    tab->old_total_slots = tab->old_nodes = tab->migrated = 0;
+    tab->changes = 0;
+    tab->weak = (is_weak != Qnil);
+
+    if (hash_fun == rep_VAL(&Sstring_hash))
+	tab->hash_type = HASH_STRING;
+    else if (hash_fun == rep_VAL(&Ssymbol_hash))
+	tab->hash_type = HASH_SYMBOL;
+    else if (hash_fun == rep_VAL(&Seq_hash))
+	tab->hash_type = HASH_EQ;
+    else if (hash_fun == rep_VAL(&Sequal_hash))
+	tab->hash_type = HASH_EQUAL;
+    else
+	tab->hash_type = HASH_LISP;
+
+    tab->compare_type = COMPARE_LISP;
+    if (rep_CELL8_TYPEP (cmp_fun, rep_Subr2))
+    {
+	/* (string= is an alias of equal) */
+	if (rep_SUBR2FUN (cmp_fun) == Feq)
+	    tab->compare_type = COMPARE_EQ;
+	else if (rep_SUBR2FUN (cmp_fun) == Feql)
+	    tab->compare_type = COMPARE_EQL;
+	else if (rep_SUBR2FUN (cmp_fun) == Fequal)
+	    tab->compare_type = COMPARE_EQUAL;
+    }
+
+    if (rep_INTP (size) && rep_INT (size) > 0)
+	resize_table (tab, slots_for_count (rep_INT (size)), rep_FALSE);
 
     return rep_VAL(tab);
 }
 
 DEFUN("make-weak-table", Fmake_weak_table, Smake_weak_table,
-      (repv hash_fun, repv cmp_fun), rep_Subr2) /*
+      (repv hash_fun, repv cmp_fun, repv size), rep_Subr3) /*
 ::doc:rep.data.tables#make-weak-table::
-make-weak-table HASH-FUNCTION COMPARE-FUNCTION
+make-weak-table HASH-FUNCTION COMPARE-FUNCTION [SIZE]
 
 Similar to `make-table, except that key-value pairs stored in the table
 are said to be ``weakly keyed''. That is, they are only retained in the
@@ -270,10 +524,12 @@ table as long the key has not been garbage collected.
 
 Unlike with tables created by the `make-table function, the fact that
 the key is stored in the table is not considered good enough to prevent
-it being garbage collected.
+it being garbage collected. Nor is the value stored with it, even if
+the value refers to the key: the value is only kept alive by the table
+while the key is reachable from elsewhere.
 ::end:: */
 {
-    return Fmake_table (hash_fun, cmp_fun, Qt);
+    return Fmake_table (hash_fun, cmp_fun, Qt, size);
 }
 
 DEFUN("tablep", Ftablep, Stablep, (repv arg), rep_Subr1) /*
@@ -290,59 +546,319 @@ static hash_value
 hash_key (repv tab, repv key)
 {
     repv hash;
-    if (TABLE(tab)->hash_fun == rep_VAL(&Sstring_hash))
-	hash = Fstring_hash (key);
-    else if (TABLE(tab)->hash_fun == rep_VAL(&Ssymbol_hash))
-	hash = Fsymbol_hash (key);
-    else if (TABLE(tab)->hash_fun == rep_VAL(&Seq_hash))
-	hash = Feq_hash (key);
-    else if (TABLE(tab)->hash_fun == rep_VAL(&Sequal_hash))
-	hash = Fequal_hash (key, Qnil);
-    else
+    switch (TABLE(tab)->hash_type)
     {
+    case HASH_STRING:
+	if (!rep_STRINGP (key))
+	{
+	    rep_signal_arg_error (key, 1);
+	    return 0;
+	}
+	return TRUNC (hash_string (key));
+
+    case HASH_SYMBOL:
+	if (!rep_SYMBOLP (key))
+	{
+	    rep_signal_arg_error (key, 1);
+	    return 0;
+	}
+	return TRUNC (hash_symbol (key));
+
+    case HASH_EQ:
+	return TRUNC ((hash_value) key);
+
+    case HASH_EQUAL:
+	return TRUNC (equal_hash (key, EQUAL_HASH_BUDGET));
+
+    default: {
 	rep_GC_root gc_tab;
 	rep_PUSHGC (gc_tab, tab);
 	hash = rep_call_lisp1 (TABLE(tab)->hash_fun, key);
 	rep_POPGC;
     }
-    return rep_INT(hash);
-}
-
-static inline int
-hash_key_to_bin (repv tab, hash_value hash)
-{
-    return hash % TABLE(tab)->total_buckets;
+    }
+    return rep_INTP (hash) ? rep_INT(hash) : 0;
 }
 
 static inline rep_bool
 compare (repv tab, repv val1, repv val2)
 {
     repv ret;
-    rep_GC_root gc_tab;
-    rep_PUSHGC (gc_tab, tab);
-    ret = rep_call_lisp2 (TABLE(tab)->compare_fun, val1, val2);
-    rep_POPGC;
-    return ret != Qnil;
+    switch (TABLE(tab)->compare_type)
+    {
+    case COMPARE_EQ:
+	return val1 == val2;
+
+    case COMPARE_EQL:
+	return val1 == val2 || Feql (val1, val2) != Qnil;
+
+    case COMPARE_EQUAL:
+	return val1 == val2 || rep_value_cmp (val1, val2) == 0;
+
+    default: {
+	rep_GC_root gc_tab;
+	rep_PUSHGC (gc_tab, tab);
+	ret = rep_call_lisp2 (TABLE(tab)->compare_fun, val1, val2);
+	rep_POPGC;
+	return ret != rep_NULL && ret != Qnil;
+    }
+    }
+}
+
+/* Return the slot of an array of SIZE slots that an entry with hash
+   code HV would ideally be stored in. The bits are mixed first, since
+   codes from eq-hash have their low bits clear. */
+static inline unsigned int
+home_slot (hash_value hv, unsigned int size)
+{
+    hv ^= hv >> 16;
+    hv *= 0x45d9f3b;
+    hv ^= hv >> 16;
+    return hv & (size - 1);
+}
+
+/* Return the number of slots needed to hold COUNT entries */
+static int
+slots_for_count (unsigned long count)
+{
+    int size = 16;
+    while (SLOTS_FULL_P (count, (unsigned long) size) && size < (1 << 30))
+	size *= 2;
+    return size;
+}
+
+/* Return the slot after INDEX in an array whose slots before FIRST
+   have already been migrated, and so are always empty. Probe runs that
+   wrap around the end of the array continue from FIRST. */
+static inline unsigned int
+next_slot (unsigned int index, unsigned int mask, unsigned int first)
+{
+    index = (index + 1) & mask;
+    return index < first ? first : index;
 }
 
-static node *
-lookup (repv tab, repv key)
+/* Search the SIZE slots of array SLOTS for KEY, ignoring the slots
+   before FIRST. Returns the index of the slot, -1 if there's no such
+   key, or -2 if the table was modified by the compare function. */
+static int
+probe (repv tab, entry *slots, unsigned int size, unsigned int first,
+       repv key, hash_value hv, unsigned int changes)
 {
+    table *t = TABLE(tab);
+    unsigned int mask = size - 1;
+    unsigned int index = home_slot (hv, size), next;
+    unsigned int distance = 1;
+
+    if (index < first)
+    {
+	/* the start of the probe sequence has been moved elsewhere */
+	distance += first - index;
+	index = first;
+    }
+
+    while (1)
+    {
+	entry *e = &slots[index];
+
+	/* an empty slot, or an entry closer to its home than KEY
+	   would be, means KEY isn't here */
+	if (e->distance < distance)
+	    return -1;
+
+	if (e->hash == hv && compare (tab, key, e->key))
+	    return t->changes != changes ? -2 : (int) index;
+	else if (t->changes != changes)
+	    return -2;
+	else if (rep_throw_value != rep_NULL)
+	    return -1;
+
+	next = next_slot (index, mask, first);
+	distance += (next - index) & mask;
+	index = next;
+    }
+}
+
+/* Add KEY and VALUE to the SIZE slots of array SLOTS. KEY must not
+   already be stored, and there must be a free slot */
+static void
+insert (entry *slots, unsigned int size, repv key, repv value, hash_value hv)
+{
+    unsigned int mask = size - 1;
+    unsigned int index = home_slot (hv, size);
+    entry new;
+
+    new.key = key;
+    new.value = value;
+    new.hash = hv;
+    new.distance = 1;
+
+    while (1)
+    {
+	entry *e = &slots[index];
+	if (e->distance == 0)
+	{
+	    *e = new;
+	    break;
+	}
+	else if (e->distance < new.distance)
+	{
+	    entry tem = *e;
+	    *e = new;
+	    new = tem;
+	}
+	index = (index + 1) & mask;
+	new.distance++;
+    }
+}
+
+/* Move up to COUNT of the old slots of table T into its new array, or
+   all of them if COUNT is negative */
+static void
+migrate (table *t, int count)
+{
+    while (t->old_slots != 0 && count-- != 0)
+    {
+	entry *e = &t->old_slots[t->migrated];
+	if (e->distance != 0)
+	{
+	    insert (t->slots, t->total_slots, e->key, e->value, e->hash);
+	    e->key = e->value = 0;
+	    e->distance = 0;
+	    t->old_nodes--;
+	}
+	if (++t->migrated == t->old_total_slots || t->old_nodes == 0)
+	{
+	    rep_free (t->old_slots);
+	    t->old_slots = 0;
+	    t->old_total_slots = t->old_nodes = t->migrated = 0;
+	}
+    }
+    t->changes++;
+}
+
+/* Give table T an array of NEW_SIZE slots. Unless INCREMENTAL is true
+   all entries are moved into it immediately, otherwise they're moved
+   a few at a time by later accesses to the table. */
+static void
+resize_table (table *t, int new_size, rep_bool incremental)
+{
+    entry *old_slots = t->slots;
+    int old_size = t->total_slots, i;
+
+    /* finish any earlier resize first */
+    migrate (t, -1);
+
+    t->slots = rep_alloc (sizeof (entry) * new_size);
+    rep_data_after_gc += sizeof (entry) * new_size;
+    memset (t->slots, 0, sizeof (entry) * new_size);
+    t->total_slots = new_size;
+    t->changes++;
+
+    if (old_size == 0)
+	return;
+    else if (incremental && t->total_nodes > 0)
+    {
+	t->old_slots = old_slots;
+	t->old_total_slots = old_size;
+	t->old_nodes = t->total_nodes;
+	t->migrated = 0;
+    }
+    else
+    {
+	for (i = 0; i < old_size; i++)
+	{
+	    entry *e = &old_slots[i];
+	    if (e->distance != 0)
+		insert (t->slots, new_size, e->key, e->value, e->hash);
+	}
+	rep_free (old_slots);
+    }
+}
+
+/* Return the entry containing KEY, or null. If HASHP is non-null the
+   hash code of KEY is stored there. Also returns null if hashing KEY
+   signalled an error, leaving rep_throw_value set. */
+static entry *
+lookup (repv tab, repv key, hash_value *hashp)
+{
+    table *t = TABLE(tab);
     hash_value hv;
-    node *ptr;
+    unsigned int changes;
     int index;
-    if (TABLE(tab)->total_buckets == 0)
+
+    if (t->old_slots != 0)
+	migrate (t, MIGRATE_STEP);
+
+    if (t->total_nodes == 0 && hashp == 0)
 	return 0;
+
     hv = hash_key (tab, key);
-    index = hash_key_to_bin (tab, hv);
-    for (ptr = TABLE(tab)->buckets[index]; ptr != 0; ptr = ptr->next)
+    if (rep_throw_value != rep_NULL)
+	return 0;
+    if (hashp != 0)
+	*hashp = hv;
+
+again:
+    if (t->total_nodes == 0)
+	return 0;
+
+    changes = t->changes;
+    index = probe (tab, t->slots, t->total_slots, 0, key, hv, changes);
+    if (index == -2)
+	goto again;
+    else if (index >= 0)
+	return &t->slots[index];
+
+    if (t->old_slots != 0)
     {
-	if (ptr->hash == hv && compare (tab, key, ptr->key))
-	    return ptr;
+	index = probe (tab, t->old_slots, t->old_total_slots,
+		       t->migrated, key, hv, changes);
+	if (index == -2)
+	    goto again;
+	else if (index >= 0)
+	    return &t->old_slots[index];
     }
+
     return 0;
 }
 
+/* Remove entry E of table T */
+static void
+remove_entry (table *t, entry *e)
+{
+    entry *slots = t->slots;
+    unsigned int mask = t->total_slots - 1, first = 0;
+    unsigned int index, next, gap;
+
+    if (t->old_slots != 0 && e >= t->old_slots
+	&& e < t->old_slots + t->old_total_slots)
+    {
+	slots = t->old_slots;
+	mask = t->old_total_slots - 1;
+	first = t->migrated;
+	t->old_nodes--;
+    }
+
+    /* shift back any following entries that could be nearer their
+       home slot. In the old array of a resizing table the slots
+       before the migration point are skipped, as probe () does */
+    index = e - slots;
+    next = next_slot (index, mask, first);
+    gap = (next - index) & mask;
+    while (slots[next].distance > gap)
+    {
+	slots[index] = slots[next];
+	slots[index].distance -= gap;
+	index = next;
+	next = next_slot (index, mask, first);
+	gap = (next - index) & mask;
+    }
+    slots[index].key = slots[index].value = 0;
+    slots[index].distance = 0;
+    t->total_nodes--;
+    t->changes++;
+}
+
 DEFUN("table-ref", Ftable_ref, Stable_ref, (repv tab, repv key), rep_Subr2) /*
 ::doc:rep.data.tables#table-ref::
 table-ref TABLE KEY
@@ -351,10 +867,12 @@ Return the value stored in hash table TABLE indexed by object KEY.
 Returns false if no such value exists.
 ::end:: */
 {
-    node *n;
+    entry *e;
     rep_DECLARE1(tab, TABLEP);
-    n = lookup (tab, key);
-    return n ? n->value : Qnil;
+    e = lookup (tab, key, 0);
+    if (e == 0 && rep_throw_value != rep_NULL)
+	return rep_NULL;
+    return e != 0 ? e->value : Qnil;
 }
 
 DEFUN("table-bound-p", Ftable_bound_p,
@@ -366,10 +884,10 @@ Returns true if the hash table TABLE contains a value associated with
 KEY.
 ::end:: */
 {
-    node *n;
     rep_DECLARE1(tab, TABLEP);
-    n = lookup (tab, key);
-    return n ? Qt : Qnil;
+    if (lookup (tab, key, 0) != 0)
+	return Qt;
+    return rep_throw_value != rep_NULL ? rep_NULL : Qnil;
 }
 
 DEFUN("table-set", Ftable_set, Stable_set,
@@ -380,63 +898,26 @@ table-set TABLE KEY VALUE
 Associate VALUE with KEY in hash table TABLE. Returns VALUE.
 ::end:: */
 {
-    node *n;
+    entry *e;
+    hash_value hv;
     rep_DECLARE1(tab, TABLEP);
-    n = lookup (tab, key);
-    if (n == 0)
+    e = lookup (tab, key, &hv);
+    if (e != 0)
+	e->value = value;
+    else if (rep_throw_value != rep_NULL)
+	return rep_NULL;
+    else
     {
-	int bin;
-	n = rep_alloc (sizeof (node));
-	rep_data_after_gc += sizeof (node);
-	n->key = key;
-	n->value = value;
-	n->hash = hash_key (tab, key);
-	TABLE(tab)->total_nodes++;
-	if (TABLE(tab)->total_nodes >= 2 * TABLE(tab)->total_buckets)
+	table *t = TABLE(tab);
+	if (TABLE_FULL_P (t))
 	{
-	    int old_size, new_size, i;
-	    node **new_bins, **old_bins;
-
-	    old_bins = TABLE(tab)->buckets;
-	    old_size = TABLE(tab)->total_buckets;
-
-	    /* The (misguided?) idea is to set number of buckets as
-	        (2^N) - 1, then increase N each time we get twice as
-		many keys as buckets. Start at N=5 */
-
-	    if (old_size == 0)
-		new_size = 31;
-	    else
-		new_size = (old_size + 1) * 2 - 1;
-
-	    new_bins = rep_alloc (sizeof (node *) * new_size);
-	    rep_data_after_gc += sizeof (node *) * new_size;
-	    memset (new_bins, 0, sizeof (node *) * new_size);
-
-	    TABLE(tab)->buckets = new_bins;
-	    TABLE(tab)->total_buckets = new_size;
-	    for (i = 0; i < old_size; i++)
-	    {
-		node *ptr, *next;
-		for (ptr = old_bins[i]; ptr != 0; ptr = next)
-		{
-		    int index = hash_key_to_bin (tab, ptr->hash);
-		    next = ptr->next;
-		    ptr->next = new_bins[index];
-		    new_bins[index] = ptr;
-		}
-	    }
-
-	    if (old_size > 0)
-		rep_free (old_bins);
+	    resize_table (t, t->total_slots == 0 ? 16 : t->total_slots * 2,
+			  t->total_slots >= INCREMENTAL_RESIZE_SLOTS);
 	}
-	bin = hash_key_to_bin (tab, n->hash);
-	n->next = TABLE(tab)->buckets[bin];
-	TABLE(tab)->buckets[bin] = n;
-	if (TABLE(tab)->guardian)
-	    Fprimitive_guardian_push (TABLE(tab)->guardian, n->key);
+	insert (t->slots, t->total_slots, key, value, hv);
+	t->total_nodes++;
+	t->changes++;
     }
-    n->value = value;
     return value;
 }
 
@@ -448,26 +929,33 @@ table-unset TABLE KEY
 Remove any value stored in TABLE associated with KEY.
 ::end:: */
 {
-    node *n;
+    entry *e;
     rep_DECLARE1(tab, TABLEP);
-    n = lookup (tab, key);
-    if (n != 0)
+    e = lookup (tab, key, 0);
+    if (e != 0)
     {
-	int bin = hash_key_to_bin (tab, n->hash);
-	node **ptr;
-	for (ptr = &(TABLE(tab)->buckets[bin]);
-	     *ptr != 0; ptr = &((*ptr)->next))
-	{
-	    if (*ptr == n)
-	    {
-		*ptr = n->next;
-		rep_free (n);
-		TABLE(tab)->total_nodes--;
-		return Qt;
-	    }
-	}
+	remove_entry (TABLE(tab), e);
+	return Qt;
     }
-    return Qnil;
+    return rep_throw_value != rep_NULL ? rep_NULL : Qnil;
+}
+
+DEFUN("table-reserve", Ftable_reserve, Stable_reserve,
+      (repv tab, repv count), rep_Subr2) /*
+::doc:rep.data.tables#table-reserve::
+table-reserve TABLE COUNT
+
+Make hash table TABLE large enough that it can hold COUNT entries
+without being resized. Returns TABLE.
+::end:: */
+{
+    int size;
+    rep_DECLARE1(tab, TABLEP);
+    rep_DECLARE2(count, rep_INTP);
+    size = slots_for_count (MAX (rep_INT (count), 0));
+    if (size > TABLE(tab)->total_slots)
+	resize_table (TABLE(tab), size, rep_FALSE);
+    return tab;
 }
 
 DEFUN("table-walk", Ftable_walk, Stable_walk,
@@ -486,13 +974,26 @@ each pair, the function is called with arguments `(KEY VALUE)'.
     rep_PUSHGC (gc_tab, tab);
     rep_PUSHGC (gc_fun, fun);
 
-    for (i = 0; i < TABLE(tab)->total_buckets; i++)
+    /* walk a single array */
+    migrate (TABLE(tab), -1);
+
+    /* FUN may modify the table, so re-read the slots each time. If it
+       removes an entry, the following entries may be shifted back into
+       the current slot, so look at it again */
+    for (i = 0; i < TABLE(tab)->total_slots; i++)
     {
-	node *n;
-	for (n = TABLE(tab)->buckets[i]; n != 0; n = n->next)
+	entry *e = &TABLE(tab)->slots[i];
+	if (e->distance != 0)
 	{
-	    if (!rep_call_lisp2 (fun, n->key, n->value))
+	    int count = TABLE(tab)->total_nodes;
+	    repv key = e->key;
+	    if (!rep_call_lisp2 (fun, key, e->value))
 		break;
+	    if (TABLE(tab)->total_nodes < count
+		&& TABLE(tab)->slots[i].key != key)
+	    {
+		i--;
+	    }
 	}
     }
 
@@ -500,38 +1001,224 @@ each pair, the function is called with arguments `(KEY VALUE)'.
     return rep_throw_value ? rep_NULL : Qnil;
 }
 
-DEFUN ("table-size", Ftable_size, Stable_size,
-       (repv tab), rep_Subr1) /*
-::doc:rep.data.tables#table-size::
-table-size TABLE
+/* Return a list or vector of what SELECT picks from each entry of
+   table T */
+enum select { SELECT_KEY, SELECT_VALUE, SELECT_PAIR };
 
-Returns the number of items currently stored in TABLE.
+static inline repv
+select_entry (entry *e, enum select what)
+{
+    switch (what)
+    {
+    case SELECT_KEY:
+	return e->key;
+    case SELECT_VALUE:
+	return e->value;
+    default:
+	return Fcons (e->key, e->value);
+    }
+}
+
+static repv
+collect_entries (table *t, enum select what, rep_bool as_vector)
+{
+    repv ret = as_vector ? rep_make_vector (t->total_nodes) : Qnil;
+    int n = 0, pass;
+
+    /* no garbage collection can happen while consing, so the table
+       can't change under us */
+    for (pass = 0; pass < 2; pass++)
+    {
+	entry *slots = pass == 0 ? t->slots : t->old_slots;
+	int i, total = pass == 0 ? t->total_slots : t->old_total_slots;
+	for (i = 0; slots != 0 && i < total; i++)
+	{
+	    if (slots[i].distance != 0)
+	    {
+		repv tem = select_entry (&slots[i], what);
+		if (as_vector)
+		    rep_VECTI (ret, n++) = tem;
+		else
+		    ret = Fcons (tem, ret);
+	    }
+	}
+    }
+    return ret;
+}
+
+DEFUN("table-keys", Ftable_keys, Stable_keys,
+      (repv tab, repv as_vector), rep_Subr2) /*
+::doc:rep.data.tables#table-keys::
+table-keys TABLE [AS-VECTOR]
+
+Return a list of the keys stored in hash table TABLE, in no particular
+order. If AS-VECTOR is true, return a vector instead of a list.
 ::end:: */
 {
-    rep_DECLARE1 (tab, TABLEP);
-    return rep_make_long_int (TABLE (tab)->total_nodes);
+    rep_DECLARE1(tab, TABLEP);
+    return collect_entries (TABLE(tab), SELECT_KEY, as_vector != Qnil);
 }
 
-DEFUN("tables-after-gc", Ftables_after_gc, Stables_after_gc, (void), rep_Subr0)
+DEFUN("table-values", Ftable_values, Stable_values,
+      (repv tab, repv as_vector), rep_Subr2) /*
+::doc:rep.data.tables#table-values::
+table-values TABLE [AS-VECTOR]
+
+Return a list of the values stored in hash table TABLE, in no
+particular order. If AS-VECTOR is true, return a vector instead of a
+list.
+::end:: */
 {
-    table *x;
-    for (x = all_tables; x != 0; x = x->next)
+    rep_DECLARE1(tab, TABLEP);
+    return collect_entries (TABLE(tab), SELECT_VALUE, as_vector != Qnil);
+}
+
+DEFUN("table->alist", Ftable_to_alist, Stable_to_alist,
+      (repv tab, repv as_vector), rep_Subr2) /*
+::doc:rep.data.tables#table->alist::
+table->alist TABLE [AS-VECTOR]
+
+Return an association list of the `(KEY . VALUE)' pairs stored in hash
+table TABLE, in no particular order. If AS-VECTOR is true, return a
+vector of the pairs instead of a list.
+::end:: */
+{
+    rep_DECLARE1(tab, TABLEP);
+    return collect_entries (TABLE(tab), SELECT_PAIR, as_vector != Qnil);
+}
+
+DEFUN("table-fold", Ftable_fold, Stable_fold,
+      (repv fun, repv seed, repv tab), rep_Subr3) /*
+::doc:rep.data.tables#table-fold::
+table-fold FUNCTION SEED TABLE
+
+Call FUNCTION for every key-value pair stored in hash table TABLE, with
+arguments `(KEY VALUE ACCUMULATOR)'. ACCUMULATOR is SEED for the first
+call, and the value returned by the previous call after that. Returns
+the value of the last call, or SEED if TABLE is empty.
+::end:: */
+{
+    rep_GC_root gc_tab, gc_fun, gc_seed;
+    int i;
+
+    rep_DECLARE3(tab, TABLEP);
+    rep_PUSHGC (gc_tab, tab);
+    rep_PUSHGC (gc_fun, fun);
+    rep_PUSHGC (gc_seed, seed);
+
+    migrate (TABLE(tab), -1);
+
+    /* as in table-walk, FUN may remove the entry it's given */
+    for (i = 0; i < TABLE(tab)->total_slots; i++)
     {
-	if (x->guardian)
+	entry *e = &TABLE(tab)->slots[i];
+	if (e->distance != 0)
 	{
-	    repv key;
-	    while ((key = Fprimitive_guardian_pop (x->guardian)) != Qnil)
+	    int count = TABLE(tab)->total_nodes;
+	    repv key = e->key;
+	    seed = rep_call_lisp3 (fun, key, e->value, seed);
+	    if (seed == rep_NULL)
+		break;
+	    if (TABLE(tab)->total_nodes < count
+		&& TABLE(tab)->slots[i].key != key)
 	    {
-		rep_GC_root gc_key;
-		rep_PUSHGC (gc_key, key);
-		Ftable_unset (rep_VAL (x), key);
-		rep_POPGC;
+		i--;
 	    }
 	}
     }
+
+    rep_POPGC; rep_POPGC; rep_POPGC;
+    return seed;
+}
+
+DEFUN("table-cursor", Ftable_cursor, Stable_cursor, (repv tab), rep_Subr1) /*
+::doc:rep.data.tables#table-cursor::
+table-cursor TABLE
+
+Return a cursor positioned before the first entry of hash table TABLE.
+Each call to `table-cursor-next' with the cursor then returns the next
+entry of the table, until all of them have been seen.
+::end:: */
+{
+    cursor *c;
+    rep_DECLARE1(tab, TABLEP);
+
+    c = rep_ALLOC_CELL (sizeof (cursor));
+    rep_data_after_gc += sizeof (cursor);
+    c->car = cursor_type;
+    c->next = all_cursors;
+    all_cursors = c;
+    c->table = tab;
+    c->index = -1;
+    c->key = Qnil;
+    c->changes = TABLE(tab)->changes;
+    return rep_VAL(c);
+}
+
+DEFUN("table-cursor-next", Ftable_cursor_next, Stable_cursor_next,
+      (repv cur), rep_Subr1) /*
+::doc:rep.data.tables#table-cursor-next::
+table-cursor-next CURSOR
+
+Advance CURSOR to the next entry of its table, returning a cons cell
+`(KEY . VALUE)' containing the entry, or false if there are no more
+entries.
+
+Removing the entry that was last returned doesn't affect the cursor.
+If the table is changed in any other way, some entries may be returned
+twice or not at all.
+::end:: */
+{
+    cursor *c;
+    table *t;
+    int i;
+
+    rep_DECLARE1(cur, CURSORP);
+    c = CURSOR(cur);
+    t = TABLE(c->table);
+
+    /* only walk a single array */
+    migrate (t, -1);
+
+    i = c->index + 1;
+    if (c->index >= 0 && t->changes != c->changes
+	&& c->index < t->total_slots
+	&& t->slots[c->index].key != c->key)
+    {
+	/* the last entry was removed, and the one after it may have
+	   been shifted back into its slot */
+	i = c->index;
+    }
+
+    for (; i < t->total_slots; i++)
+    {
+	entry *e = &t->slots[i];
+	if (e->distance != 0)
+	{
+	    c->index = i;
+	    c->key = e->key;
+	    c->changes = t->changes;
+	    return Fcons (e->key, e->value);
+	}
+    }
+
+    c->index = t->total_slots;
+    c->key = Qnil;
     return Qnil;
 }
 
+DEFUN ("table-size", Ftable_size, Stable_size,
+       (repv tab), rep_Subr1) /*
+::doc:rep.data.tables#table-size::
+table-size TABLE
+
+Returns the number of items currently stored in TABLE.
+::end:: */
+{
+    rep_DECLARE1 (tab, TABLEP);
+    return rep_make_long_int (TABLE (tab)->total_nodes);
+}
+
 
 /* dl hooks */
 
@@ -542,10 +1229,10 @@ rep_dl_init (void)
     table_type = rep_register_new_type ("table", 0, table_print, table_print,
 					table_sweep, table_mark,
 					0, 0, 0, 0, 0, 0, 0);
-    tem = Fsymbol_value (Qafter_gc_hook, Qt);
-    if (rep_VOIDP (tem))
-	tem = Qnil;
-    Fset (Qafter_gc_hook, Fcons (rep_VAL(&Stables_after_gc), tem));
+    cursor_type = rep_register_new_type ("table-cursor", 0, cursor_print,
+					 cursor_print, cursor_sweep,
+					 cursor_mark, 0, 0, 0, 0, 0, 0, 0);
+    rep_register_ephemeron_hooks (mark_weak_tables, prune_weak_tables);
 
     tem = rep_push_structure ("rep.data.tables");
     /* ::alias:tables rep.data.tables:: */
@@ -561,8 +1248,14 @@ rep_dl_init (void)
     rep_ADD_SUBR(Stable_bound_p);
     rep_ADD_SUBR(Stable_set);
     rep_ADD_SUBR(Stable_unset);
+    rep_ADD_SUBR(Stable_reserve);
     rep_ADD_SUBR(Stable_walk);
+    rep_ADD_SUBR(Stable_keys);
+    rep_ADD_SUBR(Stable_values);
+    rep_ADD_SUBR(Stable_to_alist);
+    rep_ADD_SUBR(Stable_fold);
+    rep_ADD_SUBR(Stable_cursor);
+    rep_ADD_SUBR(Stable_cursor_next);
     rep_ADD_SUBR(Stable_size);
-    rep_ADD_INTERNAL_SUBR(Stables_after_gc);
     return rep_pop_structure (tem);
 }
@@ -24,6 +24,8 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <time.h>
 #include <sys/stat.h>
 
 #ifdef HAVE_FCNTL_H
@@ -285,6 +287,7 @@ rep_directory_file_name(repv file)
 repv
 rep_delete_file(repv file)
 {
+    rep_files_changed++;
     if(unlink(rep_STR(file)) == 0)
 	return Qt;
     else
@@ -294,6 +297,7 @@ rep_delete_file(repv file)
 repv
 rep_rename_file(repv old, repv new)
 {
+    rep_files_changed++;
     if(rename(rep_STR(old), rep_STR(new)) != -1)
 	return Qt;
     else
@@ -309,6 +313,7 @@ rep_make_directory(repv dir)
     if (*(rep_STR(dir) + len - 1) == '/')
 	dir = rep_string_dupn(rep_STR(dir), len - 1);
 
+    rep_files_changed++;
     if(mkdir(rep_STR(dir), S_IRWXU | S_IRWXG | S_IRWXO) == 0)
 	return Qt;
     else
@@ -318,6 +323,7 @@ rep_make_directory(repv dir)
 repv
 rep_delete_directory(repv dir)
 {
+    rep_files_changed++;
     if(rmdir(rep_STR(dir)) == 0)
 	return Qt;
     else
@@ -329,6 +335,7 @@ rep_copy_file(repv src, repv dst)
 {
     repv res = Qt;
     int srcf;
+    rep_files_changed++;
     srcf = open(rep_STR(src), O_RDONLY);
     if(srcf != -1)
     {
@@ -568,6 +575,157 @@ rep_directory_files(repv dir_name)
     return Fsignal(Qfile_error, rep_list_2(rep_lookup_errno(), dir_name));
 }
 
+
+/* Directory listings, so that `load' can rule out most of the files
+   it looks for with a single stat of the directory, not a system call
+   for each. A listing is only used while the directory's modification
+   time is unchanged, and never while that time is the current second */
+
+struct dir_listing {
+    struct dir_listing *next;
+    char *name;				/* with trailing "/" */
+    time_t mtime;			/* of the directory when listed */
+    time_t checked;			/* when LOCAL was last checked */
+    unsigned long changes;		/* value of rep_files_changed */
+    rep_bool local, exists;
+    int count;
+    char **files;			/* sorted, or null if not listed */
+};
+
+#define DIR_LISTINGS_SIZE 64
+
+static struct dir_listing *dir_listings[DIR_LISTINGS_SIZE];
+
+/* Incremented by anything that may add or remove local files */
+unsigned long rep_files_changed;
+
+static void
+free_dir_listing_files (struct dir_listing *l)
+{
+    if (l->files != 0)
+    {
+	int i;
+	for (i = 0; i < l->count; i++)
+	    rep_free (l->files[i]);
+	rep_free (l->files);
+	l->files = 0;
+	l->count = 0;
+    }
+}
+
+static int
+compare_file_names (const void *a, const void *b)
+{
+    return strcmp (*(char **) a, *(char **) b);
+}
+
+static void
+read_dir_listing (struct dir_listing *l)
+{
+    DIR *dir;
+    struct dirent *de;
+    int allocated = 0;
+
+    free_dir_listing_files (l);
+    dir = opendir (l->name);
+    if (dir == 0)
+	return;
+    l->files = rep_alloc (sizeof (char *));
+    while ((de = readdir (dir)) != 0)
+    {
+	if (l->count + 1 > allocated)
+	{
+	    allocated = allocated ? allocated * 2 : 64;
+	    l->files = rep_realloc (l->files, allocated * sizeof (char *));
+	}
+	l->files[l->count] = rep_alloc (NAMLEN (de) + 1);
+	memcpy (l->files[l->count], de->d_name, NAMLEN (de));
+	l->files[l->count][NAMLEN (de)] = 0;
+	l->count++;
+    }
+    closedir (dir);
+    qsort (l->files, l->count, sizeof (char *), compare_file_names);
+}
+
+/* Return false if the file called FILE (an expanded file name)
+   certainly doesn't exist, true if it might */
+rep_bool
+rep_file_may_exist (repv file)
+{
+    char *name = rep_STR (file), *base = file_part (name);
+    int dir_len = base - name;
+    struct dir_listing *l;
+    unsigned int hash = 0;
+    struct stat st;
+    time_t now;
+    int i;
+
+    if (name[0] != '/' || *base == 0)
+	return rep_TRUE;
+
+    for (i = 0; i < dir_len; i++)
+	hash = hash * 33 + name[i];
+    for (l = dir_listings[hash % DIR_LISTINGS_SIZE]; l != 0; l = l->next)
+    {
+	if (strncmp (l->name, name, dir_len) == 0 && l->name[dir_len] == 0)
+	    break;
+    }
+    if (l == 0)
+    {
+	l = rep_alloc (sizeof (struct dir_listing));
+	memset (l, 0, sizeof (*l));
+	l->name = rep_alloc (dir_len + 1);
+	memcpy (l->name, name, dir_len);
+	l->name[dir_len] = 0;
+	l->next = dir_listings[hash % DIR_LISTINGS_SIZE];
+	dir_listings[hash % DIR_LISTINGS_SIZE] = l;
+    }
+
+    now = time (0);
+    if (l->checked != now || l->changes != rep_files_changed)
+    {
+	repv handler = rep_get_file_handler (rep_string_dupn (l->name, dir_len),
+					     op_file_readable_p);
+	l->local = (handler == Qnil);
+	l->checked = now;
+	l->changes = rep_files_changed;
+    }
+
+    if (!l->local)
+	free_dir_listing_files (l);
+    else if (stat (l->name, &st) != 0)
+    {
+	/* Unless it's known to be missing, just say nothing */
+	free_dir_listing_files (l);
+	l->exists = (errno != ENOENT && errno != ENOTDIR);
+    }
+    else
+    {
+	l->exists = rep_TRUE;
+	if (st.st_mtime >= now)
+	{
+	    /* Files added later in the same second wouldn't change
+	       the modification time, so don't trust a listing yet */
+	    free_dir_listing_files (l);
+	}
+	else if (l->files == 0 || st.st_mtime != l->mtime)
+	{
+	    read_dir_listing (l);
+	    l->mtime = st.st_mtime;
+	}
+    }
+
+    if (!l->local)
+	return rep_TRUE;
+    else if (!l->exists)
+	return rep_FALSE;
+    else if (l->files == 0)
+	return rep_TRUE;
+    else
+	return bsearch (&base, l->files, l->count, sizeof (char *),
+			compare_file_names) != 0;
+}
+
 repv
 rep_read_symlink (repv file)
 {
@@ -582,6 +740,7 @@ rep_read_symlink (repv file)
 repv
 rep_make_symlink (repv file, repv contents)
 {
+    rep_files_changed++;
     if (symlink (rep_STR (contents), rep_STR (file)) == 0)
 	return Qt;
     else
@@ -283,9 +283,10 @@ check_for_zombies(void)
 		    else
 #endif
 		    {
-			/* Process is dead. */
+			/* Process is dead. It may have changed files */
 			pr->pr_ExitStatus = status;
 			process_run_count--;
+			rep_files_changed++;
 			PR_SET_STATUS(pr, PR_DEAD);
 
 			/* Try to read any pending output */
@@ -461,6 +462,7 @@ kill_process(struct Proc *pr)
 	    kill(-pr->pr_Pid, SIGKILL);
 	waitpid(pr->pr_Pid, &pr->pr_ExitStatus, 0);
 	process_run_count--;
+	rep_files_changed++;
 	close_proc_files(pr);
     }
     rep_FREE_CELL(pr);
@@ -935,6 +937,7 @@ run_process(struct Proc *pr, char **argv, char *sync_input)
 		    }
 		    if(!exited)
 			waitpid(pr->pr_Pid, &pr->pr_ExitStatus, 0);
+		    rep_files_changed++;
 
 		    close(pr->pr_Stdout);
 		    close(pr->pr_Stderr);
@@ -2048,6 +2051,7 @@ rep_system (char *command)
 	    else if (x == pid)
 	    {
 		ret = rep_MAKE_INT (status);
+		rep_files_changed++;
 		break;
 	    }
 
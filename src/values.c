@@ -925,6 +925,80 @@ again:
     }
 }
 
+/* Return true if VAL will survive the collection in progress, either
+   because it has been marked, or because it is never freed. */
+rep_bool
+rep_gc_live_p (repv val)
+{
+    if (val == 0 || rep_INTP (val))
+	return rep_TRUE;
+    else if (rep_CELL_CONS_P (val))
+	return rep_GC_CONS_MARKEDP (val) || !rep_CONS_WRITABLE_P (val);
+    else if (rep_GC_CELL_MARKEDP (val) || rep_CELL_STATIC_P (val))
+	return rep_TRUE;
+    else
+    {
+	switch (rep_CELL8_TYPE (val))
+	{
+	case rep_Subr0: case rep_Subr1: case rep_Subr2: case rep_Subr3:
+	case rep_Subr4: case rep_Subr5: case rep_SubrN: case rep_SF:
+	    return rep_TRUE;
+
+	default:
+	    return rep_FALSE;
+	}
+    }
+}
+
+/* Ephemerons: objects that are only marked once some other object is
+   known to be live (e.g. the values of weak tables, once their keys
+   have been marked). After the normal marking is done, each MARK
+   function is called repeatedly until none of them returns true, i.e.
+   until none marks anything new. Then each PRUNE function is called,
+   to drop the entries whose keys weren't marked, before anything is
+   swept. */
+
+struct ephemeron_hooks {
+    struct ephemeron_hooks *next;
+    rep_bool (*mark) (void);
+    void (*prune) (void);
+};
+
+static struct ephemeron_hooks *ephemeron_hooks;
+
+void
+rep_register_ephemeron_hooks (rep_bool (*mark) (void), void (*prune) (void))
+{
+    struct ephemeron_hooks *h = rep_alloc (sizeof (struct ephemeron_hooks));
+    h->mark = mark;
+    h->prune = prune;
+    h->next = ephemeron_hooks;
+    ephemeron_hooks = h;
+}
+
+static void
+mark_ephemerons (void)
+{
+    struct ephemeron_hooks *h;
+    rep_bool marked;
+    do {
+	marked = rep_FALSE;
+	for (h = ephemeron_hooks; h != 0; h = h->next)
+	{
+	    if (h->mark ())
+		marked = rep_TRUE;
+	}
+    } while (marked);
+}
+
+static void
+prune_ephemerons (void)
+{
+    struct ephemeron_hooks *h;
+    for (h = ephemeron_hooks; h != 0; h = h->next)
+	h->prune ();
+}
+
 DEFUN("garbage-threshold", Fgarbage_threshold, Sgarbage_threshold, (repv val), rep_Subr1) /*
 ::doc:rep.data#garbage-threshold::
 garbage-threshold [NEW-VALUE]
@@ -967,8 +1041,6 @@ last garbage-collection is greater than `garbage-threshold'.
 
     rep_in_gc = rep_TRUE;
 
-    rep_macros_before_gc ();
-
     /* mark static objects */
     for(i = 0; i < next_static_root; i++)
 	rep_MARKVAL(*static_roots[i]);
@@ -1016,9 +1088,22 @@ last garbage-collection is greater than `garbage-threshold'.
 	lc = lc->next;
     }
 
+    /* keep the analysis and expansions of code still referenced */
+    rep_mark_lambda_cache ();
+    rep_macros_after_mark ();
+
+    /* mark values reachable from live keys, so that the guardians
+       see them as accessible */
+    mark_ephemerons ();
+
     /* move and mark any guarded objects that became inaccessible */
     run_guardians ();
 
+    /* the guarded objects may have made more keys live; then drop
+       the entries whose keys are still unmarked */
+    mark_ephemerons ();
+    prune_ephemerons ();
+
     /* look for dead weak references */
     rep_scan_weak_refs ();
 